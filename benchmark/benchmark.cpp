@@ -0,0 +1,475 @@
+/*
+ * =============================================================================
+ * Accelerator Extension
+ * Copyright (C) 2011 Asher Baker (asherkin).  All rights reserved.
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Standalone micro-benchmarks for the extension's hot paths, run outside srcds.
+ *
+ * Usage: accelerator_benchmark [--plugins N] [--minidump file.dmp [--symbols data/dumps/symbols]] [--elf file.so]...
+ *
+ * The v2/v3 crash signature round trip is always checked on a minidump of the benchmark itself,
+ * --minidump adds a check and timings on a real crash.
+ *
+ * Each benchmark prints wall time per operation, throughput and the number of
+ * heap allocations made per operation. Allocations are counted by wrapping
+ * malloc/calloc/realloc at link time (see AMBuilder) and routing operator new
+ * through malloc below.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <google_breakpad/processor/basic_source_line_resolver.h>
+#include <google_breakpad/processor/call_stack.h>
+#include <google_breakpad/processor/minidump_processor.h>
+#include <google_breakpad/processor/process_state.h>
+#include <google_breakpad/processor/stack_frame.h>
+#include <common/linux/dump_symbols.h>
+#include "client/linux/handler/exception_handler.h"
+
+#include "MemoryDownloader.h"
+#include "ModuleClassifier.h"
+#include "CrashSignature.h"
+#include "PluginContexts.h"
+#include "SymbolStore.h"
+#include "Breadcrumbs.h"
+
+using namespace SourceMod;
+
+static size_t allocCount = 0;
+static size_t allocBytes = 0;
+
+extern "C" {
+	void *__real_malloc(size_t size);
+	void *__real_calloc(size_t nmemb, size_t size);
+	void *__real_realloc(void *ptr, size_t size);
+
+	void *__wrap_malloc(size_t size) {
+		allocCount++;
+		allocBytes += size;
+		return __real_malloc(size);
+	}
+
+	void *__wrap_calloc(size_t nmemb, size_t size) {
+		allocCount++;
+		allocBytes += nmemb * size;
+		return __real_calloc(nmemb, size);
+	}
+
+	void *__wrap_realloc(void *ptr, size_t size) {
+		allocCount++;
+		allocBytes += size;
+		return __real_realloc(ptr, size);
+	}
+}
+
+void *operator new(size_t size) {
+	return malloc(size);
+}
+
+void *operator new[](size_t size) {
+	return malloc(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t sz) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr, size_t sz) noexcept {
+	free(ptr);
+}
+
+class BenchmarkTimer
+{
+	const char *name;
+	size_t iterations;
+	size_t bytes;
+	size_t startAllocCount;
+	size_t startAllocBytes;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	BenchmarkTimer(const char *name, size_t iterations, size_t bytes = 0) :
+		name(name), iterations(iterations), bytes(bytes)
+	{
+		startAllocCount = allocCount;
+		startAllocBytes = allocBytes;
+		start = std::chrono::steady_clock::now();
+	}
+
+	~BenchmarkTimer() {
+		auto end = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(end - start).count();
+		double allocsPerOp = (double)(allocCount - startAllocCount) / iterations;
+		double allocBytesPerOp = (double)(allocBytes - startAllocBytes) / iterations;
+
+		printf("%-32s %12.3f us/op %14.1f ops/s", name, (seconds * 1e6) / iterations, iterations / seconds);
+		if (bytes) {
+			printf(" %10.2f MB/s", (bytes / seconds) / (1024.0 * 1024.0));
+		} else {
+			printf(" %10s     ", "-");
+		}
+		printf(" %10.1f allocs/op %12.1f alloc bytes/op\n", allocsPerOp, allocBytesPerOp);
+	}
+};
+
+// Builds a per-plugin buffer in the same layout as Accelerator::OnPluginLoaded.
+static unsigned char *MakeSyntheticPluginContext(unsigned int index, unsigned int publics)
+{
+	char filename[64];
+	snprintf(filename, sizeof(filename), "synthetic/plugin%u.smx", index);
+	size_t filenameSize = strlen(filename) + 1;
+
+	std::vector<std::string> names;
+	for (unsigned int i = 0; i < publics; ++i) {
+		names.push_back("OnSyntheticPublic" + std::to_string(i));
+	}
+
+	uint32_t size = 0;
+	size += sizeof(uint32_t); // size
+	size += sizeof(void *); // GetBaseContext
+	size += filenameSize;
+	size += sizeof(uint32_t); // count
+	size += publics * sizeof(uint32_t); // pubinfo->code_offs
+	for (auto &name : names) {
+		size += name.size() + 1;
+	}
+
+	unsigned char *buffer = (unsigned char *)malloc(size);
+	unsigned char *cursor = buffer;
+
+	memcpy(cursor, &size, sizeof(uint32_t));
+	cursor += sizeof(uint32_t);
+
+	uintptr_t context = 0x1000 + (index * 0x100);
+	memcpy(cursor, &context, sizeof(void *));
+	cursor += sizeof(void *);
+
+	memcpy(cursor, filename, filenameSize);
+	cursor += filenameSize;
+
+	memcpy(cursor, &publics, sizeof(uint32_t));
+	cursor += sizeof(uint32_t);
+
+	for (unsigned int i = 0; i < publics; ++i) {
+		uint32_t codeOffs = i * 0x40;
+		memcpy(cursor, &codeOffs, sizeof(uint32_t));
+		cursor += sizeof(uint32_t);
+
+		memcpy(cursor, names[i].c_str(), names[i].size() + 1);
+		cursor += names[i].size() + 1;
+	}
+
+	return buffer;
+}
+
+static void BenchmarkSerializePluginContexts(unsigned int pluginCount)
+{
+	PluginContextMap pluginContextMap;
+	for (unsigned int i = 0; i < pluginCount; ++i) {
+		pluginContextMap[(const SourcePawn::IPluginContext *)(uintptr_t)(0x1000 + (i * 0x100))] = MakeSyntheticPluginContext(i, 50);
+	}
+
+	const size_t iterations = 1000;
+	uint32_t size = 0;
+
+	// Size is only known after the first run.
+	free(SerializePluginContextMap(pluginContextMap, size));
+
+	char name[64];
+	snprintf(name, sizeof(name), "SerializePluginContexts(%u)", pluginCount);
+
+	{
+		BenchmarkTimer timer(name, iterations, (size_t)size * iterations);
+		for (size_t i = 0; i < iterations; ++i) {
+			free(SerializePluginContextMap(pluginContextMap, size));
+		}
+	}
+
+	for (auto &it : pluginContextMap) {
+		free(it.second);
+	}
+}
+
+static void BenchmarkClassifyModule()
+{
+	ModuleClassifier classifier;
+	classifier.Init("/srv/tf2/", "/srv/tf2/tf", "/srv/tf2/tf/addons/sourcemod");
+
+	const char *paths[] = {
+		"/srv/tf2/bin/engine_srv.so",
+		"/srv/tf2/tf/bin/server_srv.so",
+		"/srv/tf2/tf/addons/metamod/bin/metamod.2.tf2.so",
+		"/srv/tf2/tf/addons/sourcemod/extensions/accelerator.ext.so",
+		"/lib/i386-linux-gnu/libc.so.6",
+		"linux-gate.so",
+	};
+	const size_t pathCount = sizeof(paths) / sizeof(paths[0]);
+
+	std::vector<std::string> codeFiles(paths, paths + pathCount);
+
+	const size_t iterations = 1000000;
+	size_t systemCount = 0;
+
+	{
+		BenchmarkTimer timer("ClassifyModule", iterations);
+		for (size_t i = 0; i < iterations; ++i) {
+			if (classifier.Classify(codeFiles[i % pathCount]) == kMTSystem) {
+				systemCount++;
+			}
+		}
+	}
+
+	if (systemCount == 0) {
+		printf("ClassifyModule: unexpected result\n");
+	}
+}
+
+static void BenchmarkBreadcrumbs()
+{
+	static Breadcrumbs breadcrumbs;
+	breadcrumbs.Init();
+
+	const size_t iterations = 10000000;
+
+	BenchmarkTimer timer("Breadcrumbs::Add", iterations);
+	for (size_t i = 0; i < iterations; ++i) {
+		breadcrumbs.Add(kBCPlugin, "benchmark.smx: player_death attacker 3 victim 7");
+	}
+}
+
+static void BenchmarkMemoryDownloader(size_t totalSize, size_t chunkSize)
+{
+	std::vector<char> chunk(chunkSize, 'A');
+	const size_t iterations = 100;
+
+	char name[64];
+	snprintf(name, sizeof(name), "MemoryDownloader(%zuK/%zuK)", totalSize / 1024, chunkSize / 1024);
+
+	BenchmarkTimer timer(name, iterations, totalSize * iterations);
+	for (size_t i = 0; i < iterations; ++i) {
+		MemoryDownloader data;
+		for (size_t written = 0; written < totalSize; written += chunkSize) {
+			data.OnDownloadWrite(nullptr, nullptr, chunk.data(), 1, chunkSize);
+		}
+	}
+}
+
+// Checks that the v3 signature decodes back to the v2 one, exits on a mismatch.
+static void CheckCrashSignatureRoundTrip(const google_breakpad::ProcessState &processState, const char *minidumpPath, std::string &signature, std::string &compactSignature)
+{
+	if (!BuildCrashSignature(processState, signature)) {
+		printf("Failed to build signature for %s\n", minidumpPath);
+		exit(1);
+	}
+
+	std::string decodedSignature;
+	if (!BuildCompactCrashSignature(processState, compactSignature) || !DecodeCompactCrashSignature(compactSignature, decodedSignature)) {
+		printf("Failed to round trip compact signature for %s\n", minidumpPath);
+		exit(1);
+	}
+
+	if (decodedSignature != signature) {
+		printf("Compact signature round trip mismatch for %s\n", minidumpPath);
+		exit(1);
+	}
+
+	printf("Signature size: v2 %zu bytes, v3 %zu bytes (%.1f%%), round trip OK\n", signature.size(), compactSignature.size(),
+		signature.empty() ? 0.0 : compactSignature.size() * 100.0 / signature.size());
+}
+
+static bool SelfDumpCallback(const google_breakpad::MinidumpDescriptor &descriptor, void *context, bool succeeded)
+{
+	if (succeeded) {
+		*static_cast<std::string *>(context) = descriptor.path();
+	}
+
+	return succeeded;
+}
+
+// Runs the signature round trip on a minidump of the benchmark itself, so it needs no input file.
+static void CheckSelfCrashSignature()
+{
+	std::string minidumpPath;
+	if (!google_breakpad::ExceptionHandler::WriteMinidump(P_tmpdir, SelfDumpCallback, &minidumpPath) || minidumpPath.empty()) {
+		printf("Failed to write a minidump of the benchmark\n");
+		exit(1);
+	}
+
+	google_breakpad::ProcessState processState;
+	google_breakpad::MinidumpProcessor minidumpProcessor(nullptr, nullptr);
+	bool processed = minidumpProcessor.Process(minidumpPath, &processState) == google_breakpad::PROCESS_OK;
+	unlink(minidumpPath.c_str());
+
+	if (!processed) {
+		printf("Failed to process %s\n", minidumpPath.c_str());
+		exit(1);
+	}
+
+	std::string signature;
+	std::string compactSignature;
+	CheckCrashSignatureRoundTrip(processState, minidumpPath.c_str(), signature, compactSignature);
+}
+
+static void BenchmarkCrashSignature(const char *minidumpPath)
+{
+	google_breakpad::ProcessState processState;
+	google_breakpad::MinidumpProcessor minidumpProcessor(nullptr, nullptr);
+
+	{
+		BenchmarkTimer timer("MinidumpProcessor::Process", 1);
+		if (minidumpProcessor.Process(minidumpPath, &processState) != google_breakpad::PROCESS_OK) {
+			printf("Failed to process %s\n", minidumpPath);
+			return;
+		}
+	}
+
+	std::string signature;
+	std::string compactSignature;
+	CheckCrashSignatureRoundTrip(processState, minidumpPath, signature, compactSignature);
+
+	const size_t iterations = 1000;
+
+	{
+		BenchmarkTimer timer("BuildCrashSignature", iterations, signature.size() * iterations);
+		for (size_t i = 0; i < iterations; ++i) {
+			BuildCrashSignature(processState, signature);
+		}
+	}
+
+	{
+		BenchmarkTimer timer("BuildCompactCrashSignature", iterations, compactSignature.size() * iterations);
+		for (size_t i = 0; i < iterations; ++i) {
+			BuildCompactCrashSignature(processState, compactSignature);
+		}
+	}
+}
+
+// Compares the stack walk without symbols to one unwinding with CFI from a symbol store.
+static void BenchmarkStackwalkSymbols(const char *minidumpPath, const char *symbolStorePath)
+{
+	SymbolStore symbolStore;
+	symbolStore.Init(symbolStorePath);
+
+	for (int withSymbols = 0; withSymbols <= 1; ++withSymbols) {
+		SymbolStoreSupplier symbolSupplier(symbolStore);
+		google_breakpad::BasicSourceLineResolver sourceLineResolver;
+		google_breakpad::MinidumpProcessor minidumpProcessor(withSymbols ? &symbolSupplier : nullptr, withSymbols ? &sourceLineResolver : nullptr);
+		google_breakpad::ProcessState processState;
+
+		{
+			BenchmarkTimer timer(withSymbols ? "MinidumpProcessor::Process (stored CFI)" : "MinidumpProcessor::Process (no symbols)", 1);
+			if (minidumpProcessor.Process(minidumpPath, &processState) != google_breakpad::PROCESS_OK) {
+				printf("Failed to process %s\n", minidumpPath);
+				return;
+			}
+		}
+
+		int requestingThread = processState.requesting_thread();
+		const google_breakpad::CallStack *stack = processState.threads()->at(requestingThread == -1 ? 0 : requestingThread);
+
+		size_t trustCounts[google_breakpad::StackFrame::FRAME_TRUST_CONTEXT + 1] = {};
+		for (auto frame : *stack->frames()) {
+			trustCounts[frame->trust]++;
+		}
+
+		printf("  %zu frames: %zu cfi, %zu frame pointer, %zu scanned\n", stack->frames()->size(),
+			trustCounts[google_breakpad::StackFrame::FRAME_TRUST_CFI] + trustCounts[google_breakpad::StackFrame::FRAME_TRUST_CFI_SCAN],
+			trustCounts[google_breakpad::StackFrame::FRAME_TRUST_FP],
+			trustCounts[google_breakpad::StackFrame::FRAME_TRUST_SCAN] + trustCounts[google_breakpad::StackFrame::FRAME_TRUST_CFI_SCAN]);
+	}
+}
+
+static void BenchmarkWriteSymbolFile(const char *elfPath)
+{
+	google_breakpad::DumpOptions options(ALL_SYMBOL_DATA, true, true, false);
+	std::ostringstream outputStream;
+
+	std::string debugFile = elfPath;
+	std::vector<std::string> debugDirs;
+
+	{
+		BenchmarkTimer timer("WriteSymbolFile", 1);
+		if (!google_breakpad::WriteSymbolFile(debugFile, debugFile, "Linux", "", debugDirs, options, outputStream)) {
+			printf("Failed to process symbol file %s\n", elfPath);
+			return;
+		}
+	}
+
+	printf("  %s: %zu bytes of symbols\n", elfPath, outputStream.str().size());
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int pluginCount = 100;
+	const char *minidumpPath = nullptr;
+	const char *symbolStorePath = nullptr;
+	std::vector<const char *> elfPaths;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--plugins") == 0 && i + 1 < argc) {
+			pluginCount = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--minidump") == 0 && i + 1 < argc) {
+			minidumpPath = argv[++i];
+		} else if (strcmp(argv[i], "--symbols") == 0 && i + 1 < argc) {
+			symbolStorePath = argv[++i];
+		} else if (strcmp(argv[i], "--elf") == 0 && i + 1 < argc) {
+			elfPaths.push_back(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [--plugins N] [--minidump file.dmp [--symbols dir]] [--elf file.so]...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	BenchmarkClassifyModule();
+	BenchmarkSerializePluginContexts(pluginCount);
+	BenchmarkBreadcrumbs();
+	BenchmarkMemoryDownloader(64 * 1024, 16 * 1024);
+	BenchmarkMemoryDownloader(8 * 1024 * 1024, 16 * 1024);
+
+	CheckSelfCrashSignature();
+
+	if (minidumpPath) {
+		BenchmarkCrashSignature(minidumpPath);
+
+		if (symbolStorePath) {
+			BenchmarkStackwalkSymbols(minidumpPath, symbolStorePath);
+		}
+	}
+
+	for (auto elfPath : elfPaths) {
+		BenchmarkWriteSymbolFile(elfPath);
+	}
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+#ifndef _INCLUDE_APPEND_ONLY_LIST_H_
+#define _INCLUDE_APPEND_ONLY_LIST_H_
+
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <thread>
+#include <utility>
+
+/**
+ * @brief Append-only list with stable element addresses and lock-free reads.
+ *
+ * Elements live in geometrically growing segments (FirstSegmentSize, then double each time)
+ * that are never reallocated, so pointers returned by Get stay valid for the lifetime of the list.
+ * Appends may come from any thread; an element becomes visible to readers only once it and
+ * every element before it are fully constructed.
+ */
+template <typename T, size_t FirstSegmentSize = 16>
+class AppendOnlyList
+{
+public:
+	AppendOnlyList() : m_reserved(0), m_published(0)
+	{
+		for (size_t i = 0; i < kMaxSegments; ++i) {
+			m_segments[i].store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	~AppendOnlyList()
+	{
+		size_t count = m_published.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i) {
+			Get(i)->~T();
+		}
+
+		for (size_t i = 0; i < kMaxSegments; ++i) {
+			::operator delete(m_segments[i].load(std::memory_order_relaxed));
+		}
+	}
+
+	AppendOnlyList(const AppendOnlyList &) = delete;
+	AppendOnlyList &operator=(const AppendOnlyList &) = delete;
+
+	/**
+	 * @brief Appends an element.
+	 * @return Index of the new element.
+	 */
+	size_t Append(T &&value)
+	{
+		size_t index = m_reserved.fetch_add(1, std::memory_order_relaxed);
+
+		size_t segment, offset;
+		Locate(index, segment, offset);
+
+		T *storage = m_segments[segment].load(std::memory_order_acquire);
+		if (!storage) {
+			T *allocated = static_cast<T *>(::operator new(SegmentSize(segment) * sizeof(T)));
+			if (m_segments[segment].compare_exchange_strong(storage, allocated, std::memory_order_acq_rel, std::memory_order_acquire)) {
+				storage = allocated;
+			} else {
+				::operator delete(allocated);
+			}
+		}
+
+		new (&storage[offset]) T(std::move(value));
+
+		// Publish in order so readers never see a gap.
+		size_t expected = index;
+		while (!m_published.compare_exchange_weak(expected, index + 1, std::memory_order_release, std::memory_order_relaxed)) {
+			expected = index;
+			std::this_thread::yield();
+		}
+
+		return index;
+	}
+
+	/**
+	 * @brief Returns the element at index, or nullptr if it has not been published yet.
+	 */
+	const T *Get(size_t index) const
+	{
+		if (index >= m_published.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+
+		size_t segment, offset;
+		Locate(index, segment, offset);
+
+		return &m_segments[segment].load(std::memory_order_acquire)[offset];
+	}
+
+	/**
+	 * @brief Returns the number of published elements.
+	 */
+	size_t Size() const
+	{
+		return m_published.load(std::memory_order_acquire);
+	}
+
+private:
+	static const size_t kMaxSegments = 24;
+
+	static size_t SegmentSize(size_t segment)
+	{
+		return FirstSegmentSize << segment;
+	}
+
+	static void Locate(size_t index, size_t &segment, size_t &offset)
+	{
+		segment = 0;
+		offset = index;
+		while (offset >= SegmentSize(segment)) {
+			offset -= SegmentSize(segment);
+			segment++;
+		}
+	}
+
+	std::atomic<T *> m_segments[kMaxSegments];
+	std::atomic<size_t> m_reserved; // Next index handed out to a writer.
+	std::atomic<size_t> m_published; // Number of fully constructed elements visible to readers.
+};
+
+#endif // !_INCLUDE_APPEND_ONLY_LIST_H_
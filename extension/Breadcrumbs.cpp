@@ -0,0 +1,244 @@
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <google_breakpad/processor/minidump.h>
+#include "Breadcrumbs.h"
+
+#if defined _LINUX
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#elif defined _WINDOWS
+#include <windows.h>
+#endif
+
+/* 010 Editor Template
+uint64 headerMagic;
+uint32 version;
+uint32 size;
+uint64 wallBase;
+uint64 monotonicBase;
+uint32 frame;
+uint32 claimed;
+uint32 dropped;
+uint32 ringCount;
+struct {
+    uint64 owner;
+    uint32 threadId;
+    uint32 head;
+    struct {
+        uint64 time;
+        uint32 sequence;
+        uint32 frame;
+        uint32 category;
+        char message[108];
+    } entries[64];
+} rings[ringCount];
+uint64 tailMagic;
+*/
+
+static const uint64_t kHeaderMagic = 0x4243525541434341ULL;
+static const uint64_t kTailMagic = 0x4243524F41434341ULL;
+static const uint32_t kVersion = 1;
+
+static const char *BreadcrumbCategoryName[kBCCount] = {
+	"map start",
+	"map end",
+	"plugin load",
+	"plugin unload",
+	"plugin",
+	"hang",
+	"hitch",
+	"memory",
+	"snapshot",
+};
+
+Breadcrumbs g_breadcrumbs;
+
+static inline uint64_t MonotonicNanoseconds()
+{
+#if defined _LINUX
+	// The coarse clock is read from the vDSO without touching the TSC, a few nanoseconds.
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#elif defined _WINDOWS
+	return GetTickCount64() * 1000000;
+#endif
+}
+
+static inline uint64_t CurrentThreadHandle()
+{
+#if defined _LINUX
+	return (uint64_t)pthread_self();
+#elif defined _WINDOWS
+	return GetCurrentThreadId();
+#endif
+}
+
+static inline uint32_t CurrentThreadId()
+{
+#if defined _LINUX
+	return (uint32_t)syscall(SYS_gettid);
+#elif defined _WINDOWS
+	return GetCurrentThreadId();
+#endif
+}
+
+void Breadcrumbs::Init()
+{
+	m_buffer.headerMagic = kHeaderMagic;
+	m_buffer.version = kVersion;
+	m_buffer.size = sizeof(m_buffer);
+	m_buffer.wallBase = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	m_buffer.monotonicBase = MonotonicNanoseconds();
+	m_buffer.ringCount = kRingCount;
+	m_buffer.tailMagic = kTailMagic;
+}
+
+Breadcrumbs::Ring *Breadcrumbs::GetRing()
+{
+	uint64_t self = CurrentThreadHandle();
+
+	uint32_t claimed = m_buffer.claimed.load(std::memory_order_acquire);
+	if (claimed > kRingCount) {
+		claimed = kRingCount;
+	}
+
+	for (uint32_t i = 0; i < claimed; ++i) {
+		if (m_buffer.rings[i].owner.load(std::memory_order_relaxed) == self) {
+			return &m_buffer.rings[i];
+		}
+	}
+
+	uint32_t index = m_buffer.claimed.fetch_add(1, std::memory_order_acq_rel);
+	if (index >= kRingCount) {
+		m_buffer.claimed.store(kRingCount, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Ring *ring = &m_buffer.rings[index];
+	ring->threadId = CurrentThreadId();
+	ring->owner.store(self, std::memory_order_release);
+	return ring;
+}
+
+void Breadcrumbs::Add(BreadcrumbCategory category, const char *message)
+{
+	Ring *ring = GetRing();
+	if (!ring) {
+		m_buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	uint32_t position = ring->head.load(std::memory_order_relaxed);
+	Entry &entry = ring->entries[position & (kRingSize - 1)];
+
+	// Mark the slot as being written first, so a crash part way through never yields a mixed entry.
+	entry.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_signal_fence(std::memory_order_release);
+
+	entry.time = MonotonicNanoseconds();
+	entry.frame = m_buffer.frame.load(std::memory_order_relaxed);
+	entry.category = category;
+
+	size_t length = strnlen(message, kMessageSize - 1);
+	memcpy(entry.message, message, length);
+	entry.message[length] = '\0';
+
+	entry.sequence.store(position + 1, std::memory_order_release);
+	ring->head.store(position + 1, std::memory_order_release);
+}
+
+static void FormatEntryTime(uint64_t wallNanoseconds, char *buffer, size_t maxlength)
+{
+	time_t seconds = wallNanoseconds / 1000000000;
+	int milliseconds = (wallNanoseconds / 1000000) % 1000;
+
+	struct tm tm;
+#if defined _WINDOWS
+	gmtime_s(&tm, &seconds);
+#else
+	gmtime_r(&seconds, &tm);
+#endif
+
+	size_t length = strftime(buffer, maxlength, "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(&buffer[length], maxlength - length, ".%03dZ", milliseconds);
+}
+
+bool Breadcrumbs::Decode(const char *minidumpPath, std::string &text)
+{
+	google_breakpad::Minidump minidump(minidumpPath);
+	if (!minidump.Read()) {
+		return false;
+	}
+
+	google_breakpad::MinidumpMemoryList *memoryList = minidump.GetMemoryList();
+	if (!memoryList) {
+		return false;
+	}
+
+	// App memory is written as its own region, but it may have been merged with a neighbour.
+	const Buffer *buffer = nullptr;
+	for (unsigned int i = 0; i < memoryList->region_count() && !buffer; ++i) {
+		google_breakpad::MinidumpMemoryRegion *region = memoryList->GetMemoryRegionAtIndex(i);
+		if (!region || region->GetSize() < sizeof(Buffer)) {
+			continue;
+		}
+
+		const uint8_t *memory = region->GetMemory();
+		if (!memory) {
+			continue;
+		}
+
+		for (size_t offset = 0; offset + sizeof(Buffer) <= region->GetSize(); offset += sizeof(uint64_t)) {
+			const Buffer *candidate = reinterpret_cast<const Buffer *>(memory + offset);
+			if (candidate->headerMagic == kHeaderMagic && candidate->version == kVersion && candidate->size == sizeof(Buffer) && candidate->tailMagic == kTailMagic) {
+				buffer = candidate;
+				break;
+			}
+		}
+	}
+
+	if (!buffer) {
+		return false;
+	}
+
+	char line[kMessageSize + 128];
+	char timeBuffer[64];
+
+	snprintf(line, sizeof(line), "Frame=%u\n", buffer->frame.load());
+	text += line;
+
+	if (buffer->dropped.load() > 0) {
+		snprintf(line, sizeof(line), "Dropped=%u\n", buffer->dropped.load());
+		text += line;
+	}
+
+	uint32_t ringCount = buffer->claimed.load();
+	if (ringCount > kRingCount) {
+		ringCount = kRingCount;
+	}
+
+	for (uint32_t i = 0; i < ringCount; ++i) {
+		const Ring &ring = buffer->rings[i];
+		uint32_t head = ring.head.load();
+		uint32_t first = (head > kRingSize) ? head - kRingSize : 0;
+
+		for (uint32_t position = first; position < head; ++position) {
+			const Entry &entry = ring.entries[position & (kRingSize - 1)];
+			if (entry.sequence.load() != position + 1) {
+				continue;
+			}
+
+			FormatEntryTime(buffer->wallBase + (entry.time - buffer->monotonicBase), timeBuffer, sizeof(timeBuffer));
+
+			const char *categoryName = (entry.category < kBCCount) ? BreadcrumbCategoryName[entry.category] : "unknown";
+			snprintf(line, sizeof(line), "%s [%u] frame %u %s: %.*s\n", timeBuffer, ring.threadId, entry.frame, categoryName, (int)kMessageSize - 1, entry.message);
+			text += line;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,98 @@
+#ifndef _INCLUDE_BREADCRUMBS_H_
+#define _INCLUDE_BREADCRUMBS_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Keep in sync with BreadcrumbCategoryName in Breadcrumbs.cpp
+enum BreadcrumbCategory {
+	kBCMapStart,
+	kBCMapEnd,
+	kBCPluginLoad,
+	kBCPluginUnload,
+	kBCPlugin,
+	kBCHang,
+	kBCHitch,
+	kBCMemory,
+	kBCSnapshot,
+
+	kBCCount
+};
+
+/**
+ * @brief Recent events, kept in fixed-size rings registered as app memory so they end up in every minidump.
+ *
+ * Each thread that adds a breadcrumb claims one ring from a static pool on first use and is its only
+ * writer, so adding is a handful of stores with no locks and no allocation, cheap enough for hot game
+ * callbacks. Threads beyond the pool size are counted and dropped. Every entry also records the game
+ * frame counter, bumped by OnGameFrame.
+ */
+class Breadcrumbs
+{
+public:
+	static const unsigned int kRingCount = 8;
+	static const unsigned int kRingSize = 64; // Power of two.
+	static const unsigned int kMessageSize = 108;
+
+	/**
+	 * @brief Stamps the buffer header. Call once before registering the buffer.
+	 */
+	void Init();
+	/**
+	 * @brief Records an event, truncating the message to kMessageSize - 1 characters. (thread safe)
+	 */
+	void Add(BreadcrumbCategory category, const char *message);
+	/**
+	 * @brief Advances the frame counter. Main thread only.
+	 */
+	void OnGameFrame() { m_buffer.frame.store(m_buffer.frame.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+	void *GetBuffer() { return &m_buffer; }
+	size_t GetBufferSize() const { return sizeof(m_buffer); }
+
+	/**
+	 * @brief Finds the breadcrumb buffer in a minidump and formats its entries, oldest first, one per line.
+	 * @return False if the minidump carries no breadcrumbs.
+	 */
+	static bool Decode(const char *minidumpPath, std::string &text);
+
+private:
+	struct Entry {
+		uint64_t time; // Monotonic nanoseconds, see Buffer::monotonicBase.
+		std::atomic<uint32_t> sequence; // Ring position + 1 once the entry is complete, 0 while it is written.
+		uint32_t frame;
+		uint32_t category;
+		char message[kMessageSize];
+	};
+
+	struct Ring {
+		std::atomic<uint64_t> owner; // Claiming thread's handle, 0 while unclaimed.
+		uint32_t threadId;
+		std::atomic<uint32_t> head; // Entries written so far.
+		Entry entries[kRingSize];
+	};
+
+	struct Buffer {
+		uint64_t headerMagic;
+		uint32_t version;
+		uint32_t size;
+		uint64_t wallBase; // Unix time in nanoseconds matching monotonicBase.
+		uint64_t monotonicBase;
+		std::atomic<uint32_t> frame;
+		std::atomic<uint32_t> claimed;
+		std::atomic<uint32_t> dropped;
+		uint32_t ringCount;
+		Ring rings[kRingCount];
+		uint64_t tailMagic;
+	};
+
+	Ring *GetRing();
+
+	Buffer m_buffer;
+};
+
+extern Breadcrumbs g_breadcrumbs;
+
+#endif // !_INCLUDE_BREADCRUMBS_H_
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <string.h>
+#include "ConsoleHistory.h"
+
+#if defined _LINUX
+#include <dlfcn.h>
+#elif defined _WINDOWS
+#include <windows.h>
+#endif
+
+/* 010 Editor Template
+uint64 headerMagic;
+uint32 version;
+uint32 size;
+uint64 head;
+char data[size];
+uint64 tailMagic;
+*/
+
+static const uint64_t kHeaderMagic = 0x4E4F435541434341ULL;
+static const uint64_t kTailMagic = 0x4E4F434F41434341ULL;
+static const uint32_t kVersion = 1;
+
+// tier0/logging.h, engines from CS:GO on.
+class ILoggingListener
+{
+public:
+	virtual void Log(const void *context, const char *message) = 0;
+};
+
+typedef void (*LoggingListenerFunc_t)(ILoggingListener *listener);
+
+// tier0/dbg.h, earlier engines.
+typedef int (*SpewOutputFunc_t)(int type, const char *message);
+typedef void (*SetSpewOutputFunc_t)(SpewOutputFunc_t func);
+typedef SpewOutputFunc_t (*GetSpewOutputFunc_t)();
+
+ConsoleHistory g_consolehistory;
+
+static class : public ILoggingListener
+{
+public:
+	void Log(const void *context, const char *message) override {
+		g_consolehistory.Append(message, strlen(message));
+	}
+} loggingListener;
+
+static SpewOutputFunc_t previousSpewOutput = nullptr;
+
+static int ConsoleHistorySpewOutput(int type, const char *message)
+{
+	g_consolehistory.Append(message, strlen(message));
+
+	// 0 = SPEW_CONTINUE
+	return previousSpewOutput ? previousSpewOutput(type, message) : 0;
+}
+
+static void *FindTier0Symbol(const char *name)
+{
+#if defined _LINUX
+	void *symbol = dlsym(RTLD_DEFAULT, name);
+	if (symbol) {
+		return symbol;
+	}
+
+	static const char *kTier0Names[] = { "libtier0.so", "libtier0_srv.so" };
+	for (const char *tier0Name : kTier0Names) {
+		void *tier0 = dlopen(tier0Name, RTLD_NOW | RTLD_NOLOAD);
+		if (!tier0) {
+			continue;
+		}
+
+		symbol = dlsym(tier0, name);
+		dlclose(tier0);
+
+		if (symbol) {
+			return symbol;
+		}
+	}
+
+	return nullptr;
+#elif defined _WINDOWS
+	HMODULE tier0 = GetModuleHandleA("tier0.dll");
+	return tier0 ? (void *)GetProcAddress(tier0, name) : nullptr;
+#endif
+}
+
+bool ConsoleHistory::Start()
+{
+	m_buffer.headerMagic = kHeaderMagic;
+	m_buffer.version = kVersion;
+	m_buffer.size = kSize;
+	m_buffer.tailMagic = kTailMagic;
+
+	auto registerListener = (LoggingListenerFunc_t)FindTier0Symbol("LoggingSystem_RegisterLoggingListener");
+	if (registerListener) {
+		registerListener(&loggingListener);
+		m_capturing = true;
+		return true;
+	}
+
+	auto setSpewOutput = (SetSpewOutputFunc_t)FindTier0Symbol("SpewOutputFunc");
+	auto getSpewOutput = (GetSpewOutputFunc_t)FindTier0Symbol("GetSpewOutputFunc");
+	if (setSpewOutput && getSpewOutput) {
+		previousSpewOutput = getSpewOutput();
+		setSpewOutput(ConsoleHistorySpewOutput);
+		m_capturing = true;
+		return true;
+	}
+
+	return false;
+}
+
+void ConsoleHistory::Stop()
+{
+	if (!m_capturing) {
+		return;
+	}
+
+	m_capturing = false;
+
+	auto unregisterListener = (LoggingListenerFunc_t)FindTier0Symbol("LoggingSystem_UnregisterLoggingListener");
+	if (unregisterListener) {
+		unregisterListener(&loggingListener);
+		return;
+	}
+
+	// Only put the previous function back if nothing was chained after ours, that would drop it.
+	auto setSpewOutput = (SetSpewOutputFunc_t)FindTier0Symbol("SpewOutputFunc");
+	auto getSpewOutput = (GetSpewOutputFunc_t)FindTier0Symbol("GetSpewOutputFunc");
+	if (setSpewOutput && getSpewOutput && getSpewOutput() == ConsoleHistorySpewOutput) {
+		setSpewOutput(previousSpewOutput);
+	}
+}
+
+void ConsoleHistory::Append(const char *text, size_t length)
+{
+	if (length > kSize) {
+		text += length - kSize;
+		length = kSize;
+	}
+
+	// Concurrent writers get disjoint ranges, only one lapping another can mix their text.
+	uint64_t start = m_buffer.head.fetch_add(length, std::memory_order_relaxed);
+	size_t offset = start & (kSize - 1);
+	size_t first = std::min(length, kSize - offset);
+
+	memcpy(&m_buffer.data[offset], text, first);
+	memcpy(m_buffer.data, text + first, length - first);
+}
+
+size_t ConsoleHistory::Copy(char *buffer, size_t size) const
+{
+	if (size == 0) {
+		return 0;
+	}
+
+	uint64_t head = m_buffer.head.load(std::memory_order_acquire);
+	size_t length = (size_t)std::min<uint64_t>(head, std::min(kSize, size - 1));
+	size_t offset = (head - length) & (kSize - 1);
+	size_t first = std::min(length, kSize - offset);
+
+	memcpy(buffer, &m_buffer.data[offset], first);
+	memcpy(buffer + first, m_buffer.data, length - first);
+	buffer[length] = '\0';
+
+	// The oldest line was cut by the ring wrapping or the buffer size, drop it.
+	if (head > length) {
+		char *lineEnd = (char *)memchr(buffer, '\n', length);
+		if (lineEnd) {
+			size_t skip = lineEnd + 1 - buffer;
+			memmove(buffer, lineEnd + 1, length - skip + 1);
+			length -= skip;
+		}
+	}
+
+	return length;
+}
@@ -0,0 +1,61 @@
+#ifndef _INCLUDE_CONSOLE_HISTORY_H_
+#define _INCLUDE_CONSOLE_HISTORY_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Recent console output, captured from tier0 into a fixed-size ring registered as app memory.
+ *
+ * Hooks the engine's logging listener, or its spew output function on engines from before the
+ * logging system, both exported by tier0 by name, so no gamedata is needed. Writers reserve their
+ * range with one atomic add and copy the text in, any thread may write. The ring only holds output
+ * from after the extension loaded, the GetSpew gamedata signature is used where capture can't start.
+ */
+class ConsoleHistory
+{
+public:
+	static const size_t kSize = 64 * 1024; // Power of two.
+
+	/**
+	 * @brief Installs the listener. Main thread only.
+	 * @return False if tier0 exports neither interface.
+	 */
+	bool Start();
+	/**
+	 * @brief Removes the listener. Main thread only.
+	 */
+	void Stop();
+	bool IsCapturing() const { return m_capturing; }
+
+	/**
+	 * @brief Records console output. (thread safe)
+	 */
+	void Append(const char *text, size_t length);
+	/**
+	 * @brief Copies out the history, oldest first and starting at a full line, NUL terminated. (signal safe)
+	 * @return Number of characters copied.
+	 */
+	size_t Copy(char *buffer, size_t size) const;
+
+	void *GetBuffer() { return &m_buffer; }
+	size_t GetBufferSize() const { return sizeof(m_buffer); }
+
+private:
+	struct Buffer {
+		uint64_t headerMagic;
+		uint32_t version;
+		uint32_t size;
+		std::atomic<uint64_t> head; // Bytes written so far.
+		char data[kSize];
+		uint64_t tailMagic;
+	};
+
+	Buffer m_buffer = {};
+	bool m_capturing = false;
+};
+
+extern ConsoleHistory g_consolehistory;
+
+#endif // !_INCLUDE_CONSOLE_HISTORY_H_
@@ -0,0 +1,257 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/procfs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "CoreDumpConverter.h"
+#include "FileUtils.h"
+#include "smsdk_ext.h"
+
+#include "client/linux/minidump_writer/linux_core_dumper.h"
+#include "client/linux/minidump_writer/minidump_writer.h"
+
+CoreDumpConverter g_coredumpconverter;
+
+// Files LinuxCoreDumper and the minidump writer read from the snapshot in place of /proc/<pid>.
+static const char *kProcFiles[] = { "auxv", "cmdline", "environ", "maps", "status" };
+
+static const char kMetadataFile[] = "metadata.txt";
+
+// Only cores whose pid has this file in its snapshot are converted.
+static const char kMarkerFile[] = "maps";
+
+// The note segment of a srcds core is a few hundred KiB at most (one set of registers per thread).
+static const size_t kMaxNoteSize = 16 * 1024 * 1024;
+
+static void RemoveSnapshot(const std::string &path)
+{
+	for (const char *procFile : kProcFiles) {
+		unlink((path + "/" + procFile).c_str());
+	}
+
+	unlink((path + "/" + kMetadataFile).c_str());
+	rmdir(path.c_str());
+}
+
+static bool ReadExactly(int fd, void *buffer, size_t length, off_t offset)
+{
+	return pread(fd, buffer, length, offset) == (ssize_t)length;
+}
+
+// Finds the pid in the NT_PRPSINFO note, reading only the ELF headers and the note segment.
+static bool ReadCorePid(int fd, pid_t &pid)
+{
+	ElfW(Ehdr) header;
+	if (!ReadExactly(fd, &header, sizeof(header), 0)) {
+		return false;
+	}
+
+	if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_type != ET_CORE || header.e_phentsize != sizeof(ElfW(Phdr))) {
+		return false;
+	}
+
+#if __WORDSIZE == 64
+	if (header.e_ident[EI_CLASS] != ELFCLASS64) {
+#else
+	if (header.e_ident[EI_CLASS] != ELFCLASS32) {
+#endif
+		return false;
+	}
+
+	for (unsigned int i = 0; i < header.e_phnum; ++i) {
+		ElfW(Phdr) programHeader;
+		if (!ReadExactly(fd, &programHeader, sizeof(programHeader), header.e_phoff + i * sizeof(programHeader))) {
+			return false;
+		}
+
+		if (programHeader.p_type != PT_NOTE || programHeader.p_filesz > kMaxNoteSize) {
+			continue;
+		}
+
+		std::string notes(programHeader.p_filesz, '\0');
+		if (!ReadExactly(fd, &notes[0], notes.size(), programHeader.p_offset)) {
+			return false;
+		}
+
+		size_t position = 0;
+		while (position + sizeof(ElfW(Nhdr)) <= notes.size()) {
+			ElfW(Nhdr) noteHeader;
+			memcpy(&noteHeader, &notes[position], sizeof(noteHeader));
+
+			size_t nameOffset = position + sizeof(noteHeader);
+			size_t descriptionOffset = nameOffset + ((noteHeader.n_namesz + 3) & ~3);
+			size_t nextOffset = descriptionOffset + ((noteHeader.n_descsz + 3) & ~3);
+			if (nextOffset > notes.size() || nextOffset <= position) {
+				break;
+			}
+
+			if (noteHeader.n_type == NT_PRPSINFO && noteHeader.n_descsz >= sizeof(elf_prpsinfo) && notes.compare(nameOffset, 4, "CORE") == 0) {
+				elf_prpsinfo processInfo;
+				memcpy(&processInfo, &notes[descriptionOffset], sizeof(processInfo));
+				pid = processInfo.pr_pid;
+				return true;
+			}
+
+			position = nextOffset;
+		}
+	}
+
+	return false;
+}
+
+bool CoreDumpConverter::Init(const char *snapshotRoot)
+{
+	const char *coreDumpPathOption = g_pSM->GetCoreConfigValue("MinidumpCoreDumpPath");
+	if (!coreDumpPathOption || !coreDumpPathOption[0]) {
+		return false;
+	}
+
+	if (mkdir(snapshotRoot, 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+
+	m_coredumppath = coreDumpPathOption;
+	m_snapshotroot = snapshotRoot;
+	m_markerpath = GetSnapshotPath(getpid()) + "/" + kMarkerFile;
+	return true;
+}
+
+std::string CoreDumpConverter::GetSnapshotPath(pid_t pid) const
+{
+	return m_snapshotroot + "/" + std::to_string(pid);
+}
+
+void CoreDumpConverter::WriteProcessSnapshot(const std::string &metadata) const
+{
+	if (!IsEnabled()) {
+		return;
+	}
+
+	std::string snapshotPath = GetSnapshotPath(getpid());
+	if (mkdir(snapshotPath.c_str(), 0700) != 0 && errno != EEXIST) {
+		return;
+	}
+
+	std::string contents;
+	for (const char *procFile : kProcFiles) {
+		if (ReadWholeFile(std::string("/proc/self/") + procFile, contents)) {
+			WriteFileAtomically(snapshotPath + "/" + procFile, contents);
+		}
+	}
+
+	WriteFileAtomically(snapshotPath + "/" + kMetadataFile, metadata);
+}
+
+std::vector<CoreDumpConverter::CoreDump> CoreDumpConverter::FindCoreDumps() const
+{
+	std::vector<CoreDump> coreDumps;
+
+	DIR *directory = opendir(m_coredumppath.c_str());
+	if (!directory) {
+		return coreDumps;
+	}
+
+	while (struct dirent *entry = readdir(directory)) {
+		std::string path = m_coredumppath + "/" + entry->d_name;
+
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+			continue;
+		}
+
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1) {
+			continue;
+		}
+
+		pid_t pid;
+		bool isCoreDump = ReadCorePid(fd, pid);
+		close(fd);
+
+		if (!isCoreDump || pid == getpid()) {
+			continue;
+		}
+
+		if (access((GetSnapshotPath(pid) + "/" + kMarkerFile).c_str(), R_OK) != 0) {
+			continue;
+		}
+
+		coreDumps.push_back({ path, pid, (uint64_t)info.st_size });
+	}
+
+	closedir(directory);
+	return coreDumps;
+}
+
+bool CoreDumpConverter::Convert(const CoreDump &coreDump, const std::string &minidumpPath) const
+{
+	std::string snapshotPath = GetSnapshotPath(coreDump.pid);
+	std::string partialPath = minidumpPath + ".part";
+
+	// The dumper maps the core and the writer only touches the notes, the stacks and whatever memory
+	// they point at, so the pages actually read are a small fraction of the file.
+	bool succeeded;
+	{
+		google_breakpad::MappingList mappings;
+		google_breakpad::AppMemoryList appMemory;
+		google_breakpad::LinuxCoreDumper dumper(coreDump.pid, coreDump.path.c_str(), snapshotPath.c_str());
+		succeeded = google_breakpad::WriteMinidump(partialPath.c_str(), mappings, appMemory, &dumper);
+	}
+
+	std::string metadata;
+	if (succeeded && ReadWholeFile(snapshotPath + "/" + kMetadataFile, metadata) && !metadata.empty()) {
+		succeeded = WriteFileAtomically(minidumpPath + ".txt", metadata);
+	}
+
+	if (succeeded && rename(partialPath.c_str(), minidumpPath.c_str()) != 0) {
+		unlink((minidumpPath + ".txt").c_str());
+		succeeded = false;
+	}
+
+	if (succeeded) {
+		unlink(coreDump.path.c_str());
+	} else {
+		unlink(partialPath.c_str());
+
+		// Don't leave the pages read so far in the page cache at the expense of the running server.
+		int fd = open(coreDump.path.c_str(), O_RDONLY);
+		if (fd != -1) {
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			close(fd);
+		}
+	}
+
+	RemoveSnapshot(snapshotPath);
+	return succeeded;
+}
+
+void CoreDumpConverter::RemoveStaleSnapshots() const
+{
+	DIR *directory = opendir(m_snapshotroot.c_str());
+	if (!directory) {
+		return;
+	}
+
+	while (struct dirent *entry = readdir(directory)) {
+		if (!isdigit((unsigned char)entry->d_name[0])) {
+			continue;
+		}
+
+		pid_t pid = atoi(entry->d_name);
+		if (pid == getpid() || kill(pid, 0) == 0 || errno != ESRCH) {
+			continue;
+		}
+
+		RemoveSnapshot(m_snapshotroot + "/" + entry->d_name);
+	}
+
+	closedir(directory);
+}
@@ -0,0 +1,73 @@
+#ifndef _INCLUDE_CORE_DUMP_CONVERTER_H_
+#define _INCLUDE_CORE_DUMP_CONVERTER_H_
+
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @brief Turns kernel core files left by a server whose in-process handler never ran into minidumps.
+ *
+ * A core file alone lacks the /proc files Breakpad needs (mappings, auxv, command line), so every
+ * running server keeps a snapshot of them, along with its crash metadata, in <snapshot root>/<pid>.
+ * The snapshot doubles as the marker that a process is ours: a core whose pid has a snapshot is
+ * converted, then the core and snapshot are removed. Snapshots of processes that exited without
+ * leaving a core are removed too. The crash handler removes the marker once it has written a
+ * minidump, so the core the kernel writes when the signal is raised again isn't reported twice.
+ *
+ * core.cfg options:
+ *   MinidumpCoreDumpPath  Directory the kernel writes core files to (see core_pattern), default "" (disabled)
+ */
+class CoreDumpConverter
+{
+public:
+	struct CoreDump {
+		std::string path;
+		pid_t pid;
+		uint64_t size;
+	};
+
+	/**
+	 * @brief Reads the core.cfg options. Main thread only.
+	 * @return False if core dump conversion is disabled.
+	 */
+	bool Init(const char *snapshotRoot);
+	bool IsEnabled() const { return !m_coredumppath.empty(); }
+	/**
+	 * @brief Path of the file that marks this process's snapshot, empty if disabled. (signal safe)
+	 */
+	const char *GetMarkerPath() const { return m_markerpath.c_str(); }
+
+	/**
+	 * @brief Snapshots this process's /proc files and the given crash metadata, replacing any earlier snapshot.
+	 */
+	void WriteProcessSnapshot(const std::string &metadata) const;
+
+	/**
+	 * @brief Lists core files written by processes that have a snapshot, other than this one.
+	 */
+	std::vector<CoreDump> FindCoreDumps() const;
+	/**
+	 * @brief Writes a minidump from a core file, and its metadata next to it as <minidump>.txt.
+	 *
+	 * The snapshot is removed either way so a core that cannot be converted is not retried on every
+	 * start, the core itself is only removed once converted.
+	 */
+	bool Convert(const CoreDump &coreDump, const std::string &minidumpPath) const;
+	/**
+	 * @brief Removes snapshots of processes that are no longer running.
+	 */
+	void RemoveStaleSnapshots() const;
+
+private:
+	std::string GetSnapshotPath(pid_t pid) const;
+
+	std::string m_coredumppath;
+	std::string m_snapshotroot;
+	std::string m_markerpath;
+};
+
+extern CoreDumpConverter g_coredumpconverter;
+
+#endif // !_INCLUDE_CORE_DUMP_CONVERTER_H_
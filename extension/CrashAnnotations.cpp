@@ -0,0 +1,109 @@
+#include <string.h>
+#include "CrashAnnotations.h"
+
+CrashAnnotations g_crashannotations;
+
+// FNV-1a.
+static inline uint32_t HashKey(const char *key)
+{
+	uint32_t hash = 2166136261u;
+	for (; *key; ++key) {
+		hash = (hash ^ (unsigned char)*key) * 16777619u;
+	}
+
+	return hash;
+}
+
+bool CrashAnnotations::IsValidKey(const char *key)
+{
+	size_t length = strnlen(key, kKeySize);
+	return length > 0 && length < kKeySize && !strpbrk(key, "=\r\n");
+}
+
+CrashAnnotations::Slot *CrashAnnotations::Find(const char *key)
+{
+	uint32_t hash = HashKey(key);
+
+	for (unsigned int probe = 0; probe < kSlotCount; ++probe) {
+		Slot &slot = m_slots[(hash + probe) & (kSlotCount - 1)];
+		if (slot.state == kSSEmpty) {
+			return nullptr;
+		}
+
+		if (slot.state == kSSUsed && strcmp(slot.key, key) == 0) {
+			return &slot;
+		}
+	}
+
+	return nullptr;
+}
+
+void CrashAnnotations::Write(Slot &slot, SlotState state, const char *key, const char *value)
+{
+	uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.state = state;
+
+	if (key != slot.key) {
+		strncpy(slot.key, key, kKeySize - 1);
+		slot.key[kKeySize - 1] = '\0';
+	}
+
+	size_t length = 0;
+	for (; value[length] && length < kValueSize - 1; ++length) {
+		slot.value[length] = (value[length] == '\r' || value[length] == '\n') ? ' ' : value[length];
+	}
+	slot.value[length] = '\0';
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool CrashAnnotations::Set(const char *key, const char *value)
+{
+	Slot *existing = Find(key);
+	if (existing) {
+		Write(*existing, kSSUsed, existing->key, value);
+		return true;
+	}
+
+	// Not set, take the first slot along the probe sequence that is free.
+	uint32_t hash = HashKey(key);
+
+	for (unsigned int probe = 0; probe < kSlotCount; ++probe) {
+		Slot &slot = m_slots[(hash + probe) & (kSlotCount - 1)];
+		if (slot.state != kSSUsed) {
+			Write(slot, kSSUsed, key, value);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CrashAnnotations::Clear(const char *key)
+{
+	Slot *slot = Find(key);
+	if (slot) {
+		Write(*slot, kSSRemoved, slot->key, "");
+	}
+}
+
+bool CrashAnnotations::Read(unsigned int index, char *key, char *value) const
+{
+	const Slot &slot = m_slots[index];
+
+	uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+	if ((sequence & 1) || slot.state != kSSUsed) {
+		return false;
+	}
+
+	memcpy(key, slot.key, kKeySize);
+	memcpy(value, slot.value, kValueSize);
+	key[kKeySize - 1] = '\0';
+	value[kValueSize - 1] = '\0';
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
@@ -0,0 +1,65 @@
+#ifndef _INCLUDE_CRASH_ANNOTATIONS_H_
+#define _INCLUDE_CRASH_ANNOTATIONS_H_
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief Key/value pairs set by plugins, written to the CONFIG section of every dump's metadata.
+ *
+ * A fixed-size open addressing table, nothing is allocated after load. Updates take a handful of
+ * stores with no locks, and each slot is guarded by a sequence counter so the crash handler can copy
+ * it out with plain reads, skipping a slot caught half way through an update.
+ */
+class CrashAnnotations
+{
+public:
+	static const unsigned int kSlotCount = 64; // Power of two.
+	static const unsigned int kKeySize = 64;
+	static const unsigned int kValueSize = 192;
+
+	/**
+	 * @brief Sets or replaces an annotation, truncating the value to kValueSize - 1 characters and
+	 * turning line breaks into spaces. Main thread only.
+	 * @return False if the table is full.
+	 */
+	bool Set(const char *key, const char *value);
+	/**
+	 * @brief Removes an annotation, if set. Main thread only.
+	 */
+	void Clear(const char *key);
+	/**
+	 * @brief Checks a key fits on a metadata line: not empty, shorter than kKeySize, no '=' or line breaks.
+	 */
+	static bool IsValidKey(const char *key);
+	/**
+	 * @brief Copies out the annotation in a slot. (signal safe)
+	 * @param key Receives the key, kKeySize bytes.
+	 * @param value Receives the value, kValueSize bytes.
+	 * @return False if the slot is empty or was being updated.
+	 */
+	bool Read(unsigned int slot, char *key, char *value) const;
+
+private:
+	enum SlotState : uint32_t {
+		kSSEmpty,
+		kSSUsed,
+		kSSRemoved, // Keeps probing going past the slot until it is reused.
+	};
+
+	struct Slot {
+		std::atomic<uint32_t> sequence; // Odd while the slot is written.
+		uint32_t state;
+		char key[kKeySize];
+		char value[kValueSize];
+	};
+
+	Slot *Find(const char *key);
+	void Write(Slot &slot, SlotState state, const char *key, const char *value);
+
+	Slot m_slots[kSlotCount] = {};
+};
+
+extern CrashAnnotations g_crashannotations;
+
+#endif // !_INCLUDE_CRASH_ANNOTATIONS_H_
@@ -0,0 +1,366 @@
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <google_breakpad/processor/process_state.h>
+#include <google_breakpad/processor/call_stack.h>
+#include <google_breakpad/processor/code_modules.h>
+#include <google_breakpad/processor/stack_frame.h>
+#include <processor/pathname_stripper.h>
+#include "CrashSignature.h"
+
+#if defined _LINUX
+#include <zlib.h>
+#endif
+
+// Everything a signature carries, shared by the text and binary encodings.
+struct CrashSignatureData {
+	uint32_t timeDateStamp = 0;
+	std::string osShort;
+	std::string cpuArch;
+	bool crashed = false;
+	std::string crashReason;
+	uint64_t crashAddress = 0;
+	int requestingThread = 0;
+	std::vector<std::pair<std::string, std::string>> modules; // Debug file name, debug identifier.
+	std::vector<std::pair<int, uint64_t>> frames; // Module index (-1 if none), offset into the module.
+};
+
+// Version 3 flags byte.
+enum CompactSignatureFlags {
+	kCSFDeflated = 1 << 0,
+};
+
+static bool CollectCrashSignature(const google_breakpad::ProcessState &processState, CrashSignatureData &data)
+{
+	if (processState.system_info()) {
+		data.osShort = processState.system_info()->os_short;
+		if (data.osShort.empty()) {
+			data.osShort = processState.system_info()->os;
+		}
+		data.cpuArch = processState.system_info()->cpu;
+	}
+
+	data.requestingThread = processState.requesting_thread();
+	if (data.requestingThread == -1) {
+		data.requestingThread = 0;
+	}
+
+	const google_breakpad::CallStack *stack = processState.threads()->at(data.requestingThread);
+	if (!stack) {
+		return false;
+	}
+
+	data.timeDateStamp = processState.time_date_stamp();
+	data.crashed = processState.crashed();
+	data.crashReason = processState.crash_reason();
+	data.crashAddress = processState.crash_address();
+
+	std::map<const google_breakpad::CodeModule *, unsigned int> moduleMap;
+
+	unsigned int moduleCount = processState.modules() ? processState.modules()->module_count() : 0;
+	data.modules.reserve(moduleCount);
+	for (unsigned int moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex) {
+		auto module = processState.modules()->GetModuleAtIndex(moduleIndex);
+		moduleMap[module] = moduleIndex;
+
+		data.modules.emplace_back(google_breakpad::PathnameStripper::File(module->debug_file()), module->debug_identifier());
+	}
+
+	int frameCount = stack->frames()->size();
+	if (frameCount > 1024) {
+		frameCount = 1024;
+	}
+
+	data.frames.reserve(frameCount);
+	for (int frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+		auto frame = stack->frames()->at(frameIndex);
+
+		int moduleIndex = -1;
+		uint64_t moduleOffset = frame->ReturnAddress();
+		if (frame->module) {
+			moduleIndex = moduleMap[frame->module];
+			moduleOffset -= frame->module->base_address();
+		}
+
+		data.frames.emplace_back(moduleIndex, moduleOffset);
+	}
+
+	return true;
+}
+
+static void FormatTextSignature(const CrashSignatureData &data, std::string &signature)
+{
+	std::ostringstream summaryStream;
+	summaryStream << 2 << "|" << data.timeDateStamp << "|" << data.osShort << "|" << data.cpuArch << "|" << data.crashed << "|" << data.crashReason << "|" << std::hex << data.crashAddress << std::dec << "|" << data.requestingThread;
+
+	for (const auto &module : data.modules) {
+		summaryStream << "|M|" << module.first << "|" << module.second;
+	}
+
+	for (const auto &frame : data.frames) {
+		summaryStream << "|F|" << frame.first << "|" << std::hex << frame.second << std::dec;
+	}
+
+	signature = summaryStream.str();
+}
+
+static void WriteVarint(std::string &output, uint64_t value)
+{
+	while (value >= 0x80) {
+		output += (char)((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+
+	output += (char)value;
+}
+
+static void WriteString(std::string &output, const std::string &value)
+{
+	WriteVarint(output, value.size());
+	output += value;
+}
+
+static bool ReadVarint(const std::string &input, size_t &position, uint64_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (position >= input.size()) {
+			return false;
+		}
+
+		unsigned char byte = input[position++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool ReadString(const std::string &input, size_t &position, std::string &value)
+{
+	uint64_t length;
+	if (!ReadVarint(input, position, length) || length > input.size() - position) {
+		return false;
+	}
+
+	value = input.substr(position, length);
+	position += length;
+	return true;
+}
+
+static void EncodeCompactSignature(const CrashSignatureData &data, std::string &output)
+{
+	WriteVarint(output, data.timeDateStamp);
+	WriteString(output, data.osShort);
+	WriteString(output, data.cpuArch);
+	WriteVarint(output, data.crashed ? 1 : 0);
+	WriteString(output, data.crashReason);
+	WriteVarint(output, data.crashAddress);
+	WriteVarint(output, data.requestingThread);
+
+	WriteVarint(output, data.modules.size());
+	for (const auto &module : data.modules) {
+		WriteString(output, module.first);
+		WriteString(output, module.second);
+	}
+
+	// Module indexes are stored off by one so frames outside any module (-1) encode as 0.
+	WriteVarint(output, data.frames.size());
+	for (const auto &frame : data.frames) {
+		WriteVarint(output, frame.first + 1);
+		WriteVarint(output, frame.second);
+	}
+}
+
+static bool DecodeCompactSignature(const std::string &input, CrashSignatureData &data)
+{
+	size_t position = 0;
+	uint64_t value;
+
+	if (!ReadVarint(input, position, value)) return false;
+	data.timeDateStamp = value;
+	if (!ReadString(input, position, data.osShort)) return false;
+	if (!ReadString(input, position, data.cpuArch)) return false;
+	if (!ReadVarint(input, position, value)) return false;
+	data.crashed = value != 0;
+	if (!ReadString(input, position, data.crashReason)) return false;
+	if (!ReadVarint(input, position, data.crashAddress)) return false;
+	if (!ReadVarint(input, position, value)) return false;
+	data.requestingThread = value;
+
+	uint64_t moduleCount;
+	if (!ReadVarint(input, position, moduleCount) || moduleCount > input.size() - position) {
+		return false;
+	}
+
+	data.modules.resize(moduleCount);
+	for (auto &module : data.modules) {
+		if (!ReadString(input, position, module.first) || !ReadString(input, position, module.second)) {
+			return false;
+		}
+	}
+
+	uint64_t frameCount;
+	if (!ReadVarint(input, position, frameCount) || frameCount > input.size() - position) {
+		return false;
+	}
+
+	data.frames.resize(frameCount);
+	for (auto &frame : data.frames) {
+		if (!ReadVarint(input, position, value) || value > moduleCount) {
+			return false;
+		}
+
+		frame.first = (int)value - 1;
+		if (!ReadVarint(input, position, frame.second)) {
+			return false;
+		}
+	}
+
+	return position == input.size();
+}
+
+static const char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void Base64Encode(const std::string &input, std::string &output)
+{
+	output.reserve(output.size() + ((input.size() + 2) / 3) * 4);
+
+	size_t i = 0;
+	for (; i + 2 < input.size(); i += 3) {
+		uint32_t triple = ((unsigned char)input[i] << 16) | ((unsigned char)input[i + 1] << 8) | (unsigned char)input[i + 2];
+		output += kBase64Alphabet[(triple >> 18) & 0x3F];
+		output += kBase64Alphabet[(triple >> 12) & 0x3F];
+		output += kBase64Alphabet[(triple >> 6) & 0x3F];
+		output += kBase64Alphabet[triple & 0x3F];
+	}
+
+	if (i < input.size()) {
+		uint32_t triple = (unsigned char)input[i] << 16;
+		if (i + 1 < input.size()) {
+			triple |= (unsigned char)input[i + 1] << 8;
+		}
+
+		output += kBase64Alphabet[(triple >> 18) & 0x3F];
+		output += kBase64Alphabet[(triple >> 12) & 0x3F];
+		output += (i + 1 < input.size()) ? kBase64Alphabet[(triple >> 6) & 0x3F] : '=';
+		output += '=';
+	}
+}
+
+static bool Base64Decode(const std::string &input, size_t start, std::string &output)
+{
+	uint32_t accumulator = 0;
+	int bits = 0;
+
+	for (size_t i = start; i < input.size() && input[i] != '='; ++i) {
+		const char *found = strchr(kBase64Alphabet, input[i]);
+		if (!found || !*found) {
+			return false;
+		}
+
+		accumulator = (accumulator << 6) | (uint32_t)(found - kBase64Alphabet);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			output += (char)((accumulator >> bits) & 0xFF);
+		}
+	}
+
+	return true;
+}
+
+bool BuildCrashSignature(const google_breakpad::ProcessState &processState, std::string &signature)
+{
+	CrashSignatureData data;
+	if (!CollectCrashSignature(processState, data)) {
+		return false;
+	}
+
+	FormatTextSignature(data, signature);
+	return true;
+}
+
+bool BuildCompactCrashSignature(const google_breakpad::ProcessState &processState, std::string &signature)
+{
+	CrashSignatureData data;
+	if (!CollectCrashSignature(processState, data)) {
+		return false;
+	}
+
+	std::string encoded;
+	EncodeCompactSignature(data, encoded);
+
+	std::string payload(1, (char)0);
+
+#if defined _LINUX
+	uLongf deflatedSize = compressBound(encoded.size());
+	std::vector<Bytef> deflated(deflatedSize);
+	if (compress2(deflated.data(), &deflatedSize, (const Bytef *)encoded.data(), encoded.size(), Z_BEST_COMPRESSION) == Z_OK) {
+		std::string header;
+		WriteVarint(header, encoded.size());
+
+		// Module names and identifiers usually compress well, tiny signatures may not.
+		if (header.size() + deflatedSize < encoded.size()) {
+			payload[0] = kCSFDeflated;
+			payload += header;
+			payload.append((const char *)deflated.data(), deflatedSize);
+		}
+	}
+#endif
+
+	if (payload[0] == 0) {
+		payload += encoded;
+	}
+
+	signature = "3|";
+	Base64Encode(payload, signature);
+	return true;
+}
+
+bool DecodeCompactCrashSignature(const std::string &signature, std::string &text)
+{
+	if (signature.compare(0, 2, "3|") != 0) {
+		return false;
+	}
+
+	std::string payload;
+	if (!Base64Decode(signature, 2, payload) || payload.empty()) {
+		return false;
+	}
+
+	unsigned char flags = payload[0];
+	std::string encoded;
+
+	if (flags & kCSFDeflated) {
+#if defined _LINUX
+		size_t position = 1;
+		uint64_t encodedSize;
+		if (!ReadVarint(payload, position, encodedSize) || encodedSize > 64 * 1024 * 1024) {
+			return false;
+		}
+
+		encoded.resize(encodedSize);
+		uLongf inflatedSize = encodedSize;
+		if (uncompress((Bytef *)&encoded[0], &inflatedSize, (const Bytef *)payload.data() + position, payload.size() - position) != Z_OK || inflatedSize != encodedSize) {
+			return false;
+		}
+#else
+		return false;
+#endif
+	} else {
+		encoded = payload.substr(1);
+	}
+
+	CrashSignatureData data;
+	if (!DecodeCompactSignature(encoded, data)) {
+		return false;
+	}
+
+	FormatTextSignature(data, text);
+	return true;
+}
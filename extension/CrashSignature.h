@@ -0,0 +1,36 @@
+#ifndef _INCLUDE_CRASH_SIGNATURE_H_
+#define _INCLUDE_CRASH_SIGNATURE_H_
+
+#include <string>
+
+namespace google_breakpad {
+	class ProcessState;
+}
+
+/**
+ * @brief Builds the version 2 presubmit crash signature for a processed minidump.
+ * @param processState Processed minidump state.
+ * @param signature Receives the pipe-delimited signature text.
+ * @return False if the requesting thread has no stack.
+ */
+bool BuildCrashSignature(const google_breakpad::ProcessState &processState, std::string &signature);
+/**
+ * @brief Builds the version 3 presubmit crash signature for a processed minidump.
+ *
+ * Carries the same fields as version 2, varint encoded with the module table stored once and frames
+ * referring to it by index, deflated when that is smaller (Linux only), sent as "3|<base64>".
+ *
+ * @param processState Processed minidump state.
+ * @param signature Receives the encoded signature.
+ * @return False if the requesting thread has no stack.
+ */
+bool BuildCompactCrashSignature(const google_breakpad::ProcessState &processState, std::string &signature);
+/**
+ * @brief Reference decoder for version 3 signatures.
+ * @param signature Version 3 signature as built by BuildCompactCrashSignature.
+ * @param text Receives the equivalent version 2 signature text.
+ * @return False if the signature is malformed.
+ */
+bool DecodeCompactCrashSignature(const std::string &signature, std::string &text);
+
+#endif // !_INCLUDE_CRASH_SIGNATURE_H_
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "DumpStorage.h"
+#include "UploadLog.h"
+#include "smsdk_ext.h"
+
+#if defined _LINUX
+#include <unistd.h>
+#include <utime.h>
+#include <zlib.h>
+#endif
+
+// Dumps modified more recently than this may still be written, by a hang watchdog or snapshot here or
+// by another server sharing the directory.
+static const time_t kSettleSeconds = 60;
+
+// How long a dump claimed by the crash uploader is left to it, a claim older than this is abandoned.
+static const time_t kClaimSeconds = 10 * 60;
+
+DumpStorage g_dumpstorage;
+
+static bool EndsWith(const char *name, const char *suffix)
+{
+	size_t nameLength = strlen(name);
+	size_t suffixLength = strlen(suffix);
+	return nameLength >= suffixLength && strcmp(&name[nameLength - suffixLength], suffix) == 0;
+}
+
+void DumpStorage::Init(const char *path)
+{
+	m_path = path;
+
+#if defined _LINUX
+	const char *compressOption = g_pSM->GetCoreConfigValue("MinidumpCompress");
+	m_compress = !compressOption || (tolower(compressOption[0]) == 'y' || compressOption[0] == '1');
+#else
+	m_compress = false;
+#endif
+
+	const char *maxAgeOption = g_pSM->GetCoreConfigValue("MinidumpRetentionDays");
+	if (maxAgeOption) {
+		m_maxage = atoi(maxAgeOption);
+	}
+
+	const char *maxCountOption = g_pSM->GetCoreConfigValue("MinidumpRetentionCount");
+	if (maxCountOption) {
+		m_maxcount = atoi(maxCountOption);
+	}
+
+	const char *maxSizeOption = g_pSM->GetCoreConfigValue("MinidumpRetentionSize");
+	if (maxSizeOption) {
+		m_maxsize = strtoull(maxSizeOption, nullptr, 10) * 1024 * 1024;
+	}
+}
+
+std::vector<DumpStorage::StoredDump> DumpStorage::List(bool settledOnly) const
+{
+	std::vector<StoredDump> dumps;
+	time_t now = time(nullptr);
+
+	IDirectory *directory = libsys->OpenDirectory(m_path.c_str());
+	if (!directory) {
+		return dumps;
+	}
+
+	while (directory->MoreFiles()) {
+		const char *name = directory->GetEntryName();
+		bool compressed = EndsWith(name, ".dmp.gz");
+
+		if (!directory->IsEntryFile() || (!compressed && !EndsWith(name, ".dmp"))) {
+			directory->NextEntry();
+			continue;
+		}
+
+		StoredDump dump;
+		dump.name = name;
+		dump.path = m_path + "/" + name;
+		dump.compressed = compressed;
+
+		// The upload thread inflates a compressed dump next to itself, don't count a copy left behind.
+		struct stat st;
+		if (!compressed && stat((dump.path + ".gz").c_str(), &st) == 0) {
+			directory->NextEntry();
+			continue;
+		}
+
+		std::string claimPath = dump.path + ".uploading";
+		if (!compressed && stat(claimPath.c_str(), &st) == 0) {
+			if (now - st.st_mtime < kClaimSeconds) {
+				directory->NextEntry();
+				continue;
+			}
+
+			remove(claimPath.c_str());
+		}
+
+		if (stat(dump.path.c_str(), &st) != 0 || (settledOnly && now - st.st_mtime < kSettleSeconds)) {
+			directory->NextEntry();
+			continue;
+		}
+
+		dump.size = st.st_size;
+		dump.modified = st.st_mtime;
+
+		std::string uncompressedPath = compressed ? dump.path.substr(0, dump.path.size() - 3) : dump.path;
+
+		dump.metapath = uncompressedPath + ".txt";
+		if (stat(dump.metapath.c_str(), &st) == 0) {
+			dump.size += st.st_size;
+		} else {
+			dump.metapath.clear();
+		}
+
+		dump.uploadedpath = uncompressedPath + ".uploaded";
+		if (stat(dump.uploadedpath.c_str(), &st) != 0) {
+			dump.uploadedpath.clear();
+		}
+
+		dumps.push_back(std::move(dump));
+
+		directory->NextEntry();
+	}
+
+	libsys->CloseDirectory(directory);
+
+	std::sort(dumps.begin(), dumps.end(), [](const StoredDump &a, const StoredDump &b) {
+		return a.modified < b.modified || (a.modified == b.modified && a.name < b.name);
+	});
+
+	return dumps;
+}
+
+time_t DumpStorage::TimeUntilSettled() const
+{
+	time_t now = time(nullptr);
+	time_t remaining = 0;
+
+	for (const auto &dump : List()) {
+		remaining = std::max(remaining, dump.modified + kSettleSeconds - now);
+	}
+
+	return std::min(remaining, kSettleSeconds);
+}
+
+void DumpStorage::EnforceRetention()
+{
+	std::vector<StoredDump> dumps = List();
+
+	uint64_t totalSize = 0;
+	for (const auto &dump : dumps) {
+		totalSize += dump.size;
+	}
+
+	time_t now = time(nullptr);
+	size_t count = dumps.size();
+
+	for (const auto &dump : dumps) {
+		const char *reason;
+		if (m_maxage && now - dump.modified > (time_t)m_maxage * 24 * 60 * 60) {
+			reason = "age";
+		} else if (m_maxcount && count > m_maxcount) {
+			reason = "count";
+		} else if (m_maxsize && totalSize > m_maxsize) {
+			reason = "size";
+		} else {
+			// Oldest first, everything from here on is newer and fits.
+			break;
+		}
+
+		remove(dump.path.c_str());
+		if (!dump.metapath.empty()) {
+			remove(dump.metapath.c_str());
+		}
+		if (!dump.uploadedpath.empty()) {
+			remove(dump.uploadedpath.c_str());
+		}
+
+		count--;
+		totalSize -= dump.size;
+
+		g_uploadlog.Message(dump.name.c_str(), "Removed by the retention policy (%s limit)", reason);
+	}
+}
+
+unsigned int DumpStorage::CompressWaiting(uint64_t &compressedBytes)
+{
+	if (!m_compress) {
+		return 0;
+	}
+
+	unsigned int compressed = 0;
+
+	for (const auto &dump : List(true)) {
+		if (dump.compressed) {
+			continue;
+		}
+
+		if (!Compress(dump.path, dump.path + ".gz")) {
+			g_uploadlog.Message(dump.name.c_str(), "Failed to compress");
+			continue;
+		}
+
+		compressed++;
+		compressedBytes += dump.size;
+	}
+
+	return compressed;
+}
+
+#if defined _LINUX
+bool DumpStorage::Compress(const std::string &path, const std::string &compressedPath)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+
+	FILE *input = fopen(path.c_str(), "rb");
+	if (!input) {
+		return false;
+	}
+
+	// Written under a temporary name, so an interrupted pass never leaves a truncated dump behind.
+	std::string temporaryPath = compressedPath + ".tmp";
+	gzFile output = gzopen(temporaryPath.c_str(), "wb");
+	if (!output) {
+		fclose(input);
+		return false;
+	}
+
+	bool succeeded = true;
+	char buffer[64 * 1024];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+		if (gzwrite(output, buffer, read) != (int)read) {
+			succeeded = false;
+			break;
+		}
+	}
+
+	succeeded = succeeded && !ferror(input);
+	fclose(input);
+	succeeded = (gzclose(output) == Z_OK) && succeeded;
+
+	// Keep the dump's age for the retention policy.
+	struct utimbuf times = { st.st_atime, st.st_mtime };
+	succeeded = succeeded && utime(temporaryPath.c_str(), &times) == 0 && rename(temporaryPath.c_str(), compressedPath.c_str()) == 0;
+
+	if (!succeeded) {
+		unlink(temporaryPath.c_str());
+		return false;
+	}
+
+	unlink(path.c_str());
+	return true;
+}
+
+std::string DumpStorage::Decompress(const StoredDump &dump)
+{
+	std::string path = dump.path.substr(0, dump.path.size() - 3);
+
+	gzFile input = gzopen(dump.path.c_str(), "rb");
+	if (!input) {
+		return std::string();
+	}
+
+	FILE *output = fopen(path.c_str(), "wb");
+	if (!output) {
+		gzclose(input);
+		return std::string();
+	}
+
+	bool succeeded = true;
+	char buffer[64 * 1024];
+	int read;
+	while ((read = gzread(input, buffer, sizeof(buffer))) > 0) {
+		if (fwrite(buffer, 1, read, output) != (size_t)read) {
+			succeeded = false;
+			break;
+		}
+	}
+
+	succeeded = succeeded && read == 0;
+	gzclose(input);
+	succeeded = (fclose(output) == 0) && succeeded;
+
+	if (!succeeded) {
+		unlink(path.c_str());
+		return std::string();
+	}
+
+	return path;
+}
+#else
+bool DumpStorage::Compress(const std::string &path, const std::string &compressedPath)
+{
+	return false;
+}
+
+std::string DumpStorage::Decompress(const StoredDump &dump)
+{
+	return std::string();
+}
+#endif
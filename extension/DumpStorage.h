@@ -0,0 +1,81 @@
+#ifndef _INCLUDE_DUMP_STORAGE_H_
+#define _INCLUDE_DUMP_STORAGE_H_
+
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+/**
+ * @brief Keeps the dumps waiting in the dumps directory compressed and within a retention policy.
+ *
+ * Only the minidumps at the top of the directory are managed (name.dmp, or name.dmp.gz once
+ * compressed, each with an optional name.dmp.txt metadata file), the symbols, processes and hitches
+ * subdirectories are left alone. Dumps are evicted oldest first once they are older than the age
+ * limit, or until the rest fit in the count and size limits. A dump with a name.dmp.uploading claim
+ * from the crash uploader is left out for ten minutes, after which the claim is dropped. A
+ * name.dmp.uploaded marker left by the crash uploader goes with its dump.
+ *
+ * Compression uses zlib and is only available on Linux. Used from the upload thread only.
+ *
+ * core.cfg options:
+ *   MinidumpCompress        "yes" (default) to gzip dumps that are left waiting after an upload pass
+ *   MinidumpRetentionDays   Maximum age of a waiting dump, default 14, 0 for no limit
+ *   MinidumpRetentionCount  Maximum number of waiting dumps, default 50, 0 for no limit
+ *   MinidumpRetentionSize   Maximum size of the waiting dumps in MiB, metadata included, default 1024, 0 for no limit
+ */
+class DumpStorage
+{
+public:
+	struct StoredDump {
+		std::string name; // As stored, .gz included.
+		std::string path;
+		std::string metapath; // Empty if the dump has no metadata.
+		std::string uploadedpath; // Marker holding the crash uploader's response, empty if it has none.
+		uint64_t size; // Dump and metadata.
+		time_t modified;
+		bool compressed;
+	};
+
+	/**
+	 * @brief Reads the core.cfg options.
+	 */
+	void Init(const char *path);
+	/**
+	 * @brief Lists the waiting dumps, oldest first.
+	 * @param settledOnly Leaves out dumps modified in the last minute, which may still be being written.
+	 */
+	std::vector<StoredDump> List(bool settledOnly = false) const;
+	/**
+	 * @brief Seconds until the most recently modified dump has settled, 0 if they all have.
+	 */
+	time_t TimeUntilSettled() const;
+	/**
+	 * @brief Removes the dumps the retention policy doesn't allow for.
+	 */
+	void EnforceRetention();
+	/**
+	 * @brief Compresses every uncompressed dump that is not being written right now.
+	 * @param compressedBytes Incremented by the size of each dump compressed.
+	 * @return Number of dumps compressed.
+	 */
+	unsigned int CompressWaiting(uint64_t &compressedBytes);
+	/**
+	 * @brief Inflates a compressed dump next to itself, under its name without .gz.
+	 * @return Path of the inflated dump, empty on failure.
+	 */
+	static std::string Decompress(const StoredDump &dump);
+
+private:
+	static bool Compress(const std::string &path, const std::string &compressedPath);
+
+	std::string m_path;
+	bool m_compress = true;
+	unsigned int m_maxage = 14; // Days.
+	unsigned int m_maxcount = 50;
+	uint64_t m_maxsize = 1024ULL * 1024 * 1024;
+};
+
+extern DumpStorage g_dumpstorage;
+
+#endif // !_INCLUDE_DUMP_STORAGE_H_
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "FileUtils.h"
+
+bool ReadWholeFile(const std::string &path, std::string &contents)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+
+	contents.clear();
+
+	char buffer[8192];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		contents.append(buffer, read);
+	}
+
+	bool succeeded = !ferror(file);
+	fclose(file);
+	return succeeded;
+}
+
+bool WriteFileAtomically(const std::string &path, const std::string &contents)
+{
+	std::string tempPath = path + ".tmp";
+
+	FILE *file = fopen(tempPath.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+
+	bool succeeded = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+	succeeded = (fclose(file) == 0) && succeeded;
+
+	if (!succeeded || rename(tempPath.c_str(), path.c_str()) != 0) {
+		unlink(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,19 @@
+#ifndef _INCLUDE_FILE_UTILS_H_
+#define _INCLUDE_FILE_UTILS_H_
+
+#include <string>
+
+/**
+ * @brief Reads a whole file, until the end rather than by size, so files under /proc work too.
+ * @return False if the file couldn't be opened or read.
+ */
+bool ReadWholeFile(const std::string &path, std::string &contents);
+
+/**
+ * @brief Replaces a file through a temporary file and a rename, so readers and a crash part way
+ * through never see it partially written. Linux only, rename doesn't replace files on Windows.
+ * @return False if the file couldn't be written, the original is left alone then.
+ */
+bool WriteFileAtomically(const std::string &path, const std::string &contents);
+
+#endif // !_INCLUDE_FILE_UTILS_H_
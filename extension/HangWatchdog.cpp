@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include "HangWatchdog.h"
+#include "Breadcrumbs.h"
+#include "UploadLog.h"
+#include "UploadScheduler.h"
+
+static const std::chrono::seconds kCheckInterval(1);
+
+HangWatchdog g_hangwatchdog;
+
+bool HangWatchdog::Start(WriteHangDumpFn writeHangDump)
+{
+	const char *timeoutOption = g_pSM->GetCoreConfigValue("MinidumpHangTimeout");
+	if (!timeoutOption || atoi(timeoutOption) <= 0) {
+		return false;
+	}
+
+	m_timeout = std::chrono::seconds(atoi(timeoutOption));
+
+	const char *intervalOption = g_pSM->GetCoreConfigValue("MinidumpHangInterval");
+	if (intervalOption) {
+		m_interval = std::chrono::seconds(atoi(intervalOption));
+	}
+
+	m_writehangdump = writeHangDump;
+	return StartThread(kCheckInterval);
+}
+
+void HangWatchdog::SetLevelChanging(bool levelChanging)
+{
+	if (!levelChanging) {
+		// The first frame of the new map may be a while off, count the stall from here.
+		m_armedsince.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+	}
+
+	m_levelchanging.store(levelChanging, std::memory_order_relaxed);
+}
+
+bool HangWatchdog::Tick()
+{
+	auto lastFrame = g_uploadscheduler.GetLastFrameTime();
+
+	// The player count is the one seen by the last frame, so an empty server that stopped ticking to hibernate never arms it.
+	if (lastFrame == std::chrono::steady_clock::time_point() || m_levelchanging.load(std::memory_order_relaxed) || g_uploadscheduler.GetHumanPlayers() == 0) {
+		m_dumpedthisstall = false;
+		return true;
+	}
+
+	auto armedSince = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(m_armedsince.load(std::memory_order_relaxed)));
+	auto now = std::chrono::steady_clock::now();
+	auto stall = now - std::max(lastFrame, armedSince);
+
+	if (stall < m_timeout) {
+		m_dumpedthisstall = false;
+		return true;
+	}
+
+	if (m_dumpedthisstall) {
+		return true;
+	}
+
+	m_dumpedthisstall = true;
+
+	unsigned int stallSeconds = std::chrono::duration_cast<std::chrono::seconds>(stall).count();
+
+	if (m_lastdump != std::chrono::steady_clock::time_point() && now - m_lastdump < m_interval) {
+		g_uploadlog.Message(nullptr, "No game frame for %u seconds, hang dump skipped (rate limited)", stallSeconds);
+		return true;
+	}
+
+	m_lastdump = now;
+
+	char message[Breadcrumbs::kMessageSize];
+	snprintf(message, sizeof(message), "No game frame for %u seconds", stallSeconds);
+	g_breadcrumbs.Add(kBCHang, message);
+
+	bool written = m_writehangdump(stallSeconds);
+	g_uploadlog.Message(nullptr, "No game frame for %u seconds, %s", stallSeconds, written ? "wrote hang dump" : "failed to write hang dump");
+	g_uploadlog.Flush();
+	return true;
+}
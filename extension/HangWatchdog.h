@@ -0,0 +1,57 @@
+#ifndef _INCLUDE_HANG_WATCHDOG_H_
+#define _INCLUDE_HANG_WATCHDOG_H_
+
+#include <atomic>
+#include <chrono>
+#include "PeriodicWorker.h"
+
+/**
+ * @brief Writes a minidump of the live process when the main thread stops producing game frames.
+ *
+ * A dedicated thread checks the frame heartbeat kept by the upload scheduler once a second. It is
+ * only armed while human players are connected and no level change is in progress, so hibernation
+ * and map loads never count as a hang. One dump is written per stall, and no more often than the
+ * configured interval.
+ *
+ * core.cfg options:
+ *   MinidumpHangTimeout   Seconds without a frame before a hang dump is written, default 0 (disabled)
+ *   MinidumpHangInterval  Minimum seconds between hang dumps, default 3600
+ */
+class HangWatchdog : public PeriodicWorker
+{
+public:
+	/**
+	 * @brief Writes the dump, blaming the main thread where the platform allows it.
+	 * @param stallSeconds How long the main thread has been stalled.
+	 */
+	typedef bool (*WriteHangDumpFn)(unsigned int stallSeconds);
+
+	/**
+	 * @brief Reads the core.cfg options and starts the watchdog thread. Main thread only.
+	 * @return False if the watchdog is disabled.
+	 */
+	bool Start(WriteHangDumpFn writeHangDump);
+	/**
+	 * @brief Disarms the watchdog from level shutdown until the next map has started. Main thread only.
+	 */
+	void SetLevelChanging(bool levelChanging);
+
+protected: // PeriodicWorker
+	bool Tick();
+
+private:
+	WriteHangDumpFn m_writehangdump = nullptr;
+	std::chrono::seconds m_timeout{0};
+	std::chrono::seconds m_interval{3600};
+
+	std::atomic<bool> m_levelchanging{false};
+	std::atomic<int64_t> m_armedsince{0}; // steady_clock ticks of the last level change end.
+
+	// Watchdog thread only.
+	bool m_dumpedthisstall = false;
+	std::chrono::steady_clock::time_point m_lastdump;
+};
+
+extern HangWatchdog g_hangwatchdog;
+
+#endif // !_INCLUDE_HANG_WATCHDOG_H_
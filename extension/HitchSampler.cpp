@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <link.h>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "HitchSampler.h"
+#include "RealtimeSignals.h"
+#include "Breadcrumbs.h"
+#include "SymbolStore.h"
+#include "UploadLog.h"
+#include "UploadScheduler.h"
+
+// Time between two samples of the same hitch.
+static const std::chrono::milliseconds kSampleInterval(5);
+// How long to wait for the main thread to take a sample before giving up on the hitch.
+static const std::chrono::milliseconds kSampleTimeout(20);
+// Minimum time between two sampled hitches, so a server that is always over budget isn't sampled constantly.
+static const std::chrono::seconds kMinHitchSpacing(10);
+// Longer stalls are hangs or level loads, not hitches.
+static const std::chrono::seconds kMaxHitchDuration(5);
+// The signal handler and the signal trampoline.
+static const int kSkippedFrames = 2;
+
+HitchSampler g_hitchsampler;
+
+std::atomic<HitchSampler::Sample *> HitchSampler::s_pending{nullptr};
+
+struct AddressRange {
+	uintptr_t start;
+	uintptr_t end;
+};
+
+// Code that may run with the loader's lock held. The unwinder takes that lock to find unwind tables,
+// so unwinding from a signal that interrupted one of these would deadlock the main thread.
+static AddressRange unsafeRanges[16];
+static int unsafeRangeCount = 0;
+
+static void AddUnsafeRange(uintptr_t start, uintptr_t end)
+{
+	if (unsafeRangeCount < (int)(sizeof(unsafeRanges) / sizeof(unsafeRanges[0]))) {
+		unsafeRanges[unsafeRangeCount++] = { start, end };
+	}
+}
+
+static int CollectUnsafeRanges(struct dl_phdr_info *info, size_t size, void *data)
+{
+	if (!info->dlpi_name || (!strstr(info->dlpi_name, "/ld-") && !strstr(info->dlpi_name, "/libgcc_s."))) {
+		return 0;
+	}
+
+	for (int i = 0; i < info->dlpi_phnum; ++i) {
+		const ElfW(Phdr) &header = info->dlpi_phdr[i];
+		if (header.p_type == PT_LOAD && (header.p_flags & PF_X)) {
+			AddUnsafeRange(info->dlpi_addr + header.p_vaddr, info->dlpi_addr + header.p_vaddr + header.p_memsz);
+		}
+	}
+
+	return 0;
+}
+
+static void FindUnsafeRanges()
+{
+	dl_iterate_phdr(CollectUnsafeRanges, nullptr);
+
+	Dl_info info;
+	const ElfW(Sym) *symbol = nullptr;
+	if (dladdr1((void *)dl_iterate_phdr, &info, (void **)&symbol, RTLD_DL_SYMENT) && symbol && info.dli_saddr) {
+		AddUnsafeRange((uintptr_t)info.dli_saddr, (uintptr_t)info.dli_saddr + symbol->st_size);
+	}
+}
+
+static uintptr_t GetInterruptedAddress(void *context)
+{
+	const ucontext_t *userContext = static_cast<const ucontext_t *>(context);
+#if defined __x86_64__
+	return userContext->uc_mcontext.gregs[REG_RIP];
+#else
+	return userContext->uc_mcontext.gregs[REG_EIP];
+#endif
+}
+
+void HitchSampler::SignalHandler(int signal, siginfo_t *info, void *context)
+{
+	Sample *sample = s_pending.load(std::memory_order_acquire);
+	if (!sample) {
+		return;
+	}
+
+	uintptr_t address = GetInterruptedAddress(context);
+
+	bool safe = true;
+	for (int i = 0; i < unsafeRangeCount; ++i) {
+		if (address >= unsafeRanges[i].start && address < unsafeRanges[i].end) {
+			safe = false;
+			break;
+		}
+	}
+
+	if (safe) {
+		sample->depth = backtrace(sample->frames, kMaxDepth);
+	} else {
+		// Keep just the interrupted address, laid out like a backtrace taken from here.
+		sample->frames[kSkippedFrames] = (void *)address;
+		sample->depth = kSkippedFrames + 1;
+	}
+
+	s_pending.compare_exchange_strong(sample, nullptr, std::memory_order_release, std::memory_order_relaxed);
+}
+
+bool HitchSampler::Start(const char *outputPath)
+{
+	const char *thresholdOption = g_pSM->GetCoreConfigValue("MinidumpHitchThreshold");
+	if (!thresholdOption || atoi(thresholdOption) <= 0) {
+		return false;
+	}
+
+	m_threshold = std::chrono::milliseconds(atoi(thresholdOption));
+
+	const char *maxFilesOption = g_pSM->GetCoreConfigValue("MinidumpHitchFiles");
+	if (maxFilesOption) {
+		m_maxfiles = atoi(maxFilesOption);
+	}
+
+	if (mkdir(outputPath, 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+
+	m_outputpath = outputPath;
+	m_samples.resize(kMaxSamples);
+	m_mainthread = pthread_self();
+
+	// backtrace() loads the unwinder on first use, which isn't safe from a signal handler.
+	void *warmup[1];
+	backtrace(warmup, 1);
+
+	FindUnsafeRanges();
+
+	if (!ClaimRealtimeSignal(HITCH_SAMPLE_SIGNAL, SignalHandler)) {
+		smutils->LogMessage(myself, "WARNING: Signal %d already has a handler, the hitch sampler is disabled", HITCH_SAMPLE_SIGNAL);
+		return false;
+	}
+
+	// Check often enough to catch a frame shortly after it crosses the threshold.
+	auto pollInterval = std::min(std::max(m_threshold / 4, std::chrono::milliseconds(5)), std::chrono::milliseconds(50));
+
+	if (!StartThread(pollInterval)) {
+		ReleaseRealtimeSignal(HITCH_SAMPLE_SIGNAL);
+		return false;
+	}
+
+	return true;
+}
+
+void HitchSampler::Shutdown()
+{
+	bool started = IsRunning();
+
+	PeriodicWorker::Shutdown();
+
+	if (started) {
+		ReleaseRealtimeSignal(HITCH_SAMPLE_SIGNAL);
+	}
+}
+
+bool HitchSampler::Tick()
+{
+	auto frameStart = g_uploadscheduler.GetLastFrameTime();
+	if (frameStart == std::chrono::steady_clock::time_point() || frameStart == m_skippedframe || g_uploadscheduler.GetHumanPlayers() == 0) {
+		return true;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - frameStart < m_threshold) {
+		return true;
+	}
+
+	if (m_lasthitch != std::chrono::steady_clock::time_point() && now - m_lasthitch < kMinHitchSpacing) {
+		m_skippedframe = frameStart;
+		return true;
+	}
+
+	m_lasthitch = now;
+	SampleHitch(frameStart);
+	m_skippedframe = frameStart;
+	return true;
+}
+
+void HitchSampler::SampleHitch(std::chrono::steady_clock::time_point frameStart)
+{
+	unsigned int sampleCount = 0;
+
+	while (sampleCount < kMaxSamples && g_uploadscheduler.GetLastFrameTime() == frameStart) {
+		if (std::chrono::steady_clock::now() - frameStart > kMaxHitchDuration) {
+			return;
+		}
+
+		Sample *sample = &m_samples[sampleCount];
+		sample->depth = 0;
+		s_pending.store(sample, std::memory_order_release);
+
+		if (pthread_kill(m_mainthread, HITCH_SAMPLE_SIGNAL) != 0) {
+			s_pending.store(nullptr, std::memory_order_relaxed);
+			break;
+		}
+
+		auto requested = std::chrono::steady_clock::now();
+		while (s_pending.load(std::memory_order_acquire) && std::chrono::steady_clock::now() - requested < kSampleTimeout) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+		// The main thread isn't taking signals, don't leave it a slot that may be reused under it.
+		if (s_pending.exchange(nullptr, std::memory_order_acq_rel)) {
+			break;
+		}
+
+		sampleCount++;
+
+		if (!WaitFor(kSampleInterval)) {
+			return;
+		}
+	}
+
+	// Wait for the frame to end to know how long it took, samples taken so far are kept either way.
+	auto frameEnd = g_uploadscheduler.GetLastFrameTime();
+	while (frameEnd == frameStart) {
+		if (std::chrono::steady_clock::now() - frameStart > kMaxHitchDuration || !WaitFor(kSampleInterval)) {
+			return;
+		}
+
+		frameEnd = g_uploadscheduler.GetLastFrameTime();
+	}
+
+	if (sampleCount == 0) {
+		return;
+	}
+
+	unsigned int frameMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(frameEnd - frameStart).count();
+	WriteCollapsedStacks(sampleCount, frameMilliseconds);
+
+	char message[Breadcrumbs::kMessageSize];
+	snprintf(message, sizeof(message), "Frame took %u ms, %u stack samples", frameMilliseconds, sampleCount);
+	g_breadcrumbs.Add(kBCHitch, message);
+	g_uploadlog.Message(nullptr, "%s", message);
+}
+
+void HitchSampler::WriteCollapsedStacks(unsigned int sampleCount, unsigned int frameMilliseconds)
+{
+	struct Module {
+		std::string name;
+		std::string path;
+	};
+
+	std::map<const void *, std::string> frameNames;
+	std::map<const void *, Module> modules; // Keyed by load address.
+	std::map<std::string, unsigned int> stacks;
+
+	for (unsigned int i = 0; i < sampleCount; ++i) {
+		const Sample &sample = m_samples[i];
+
+		std::string stack;
+		for (int frame = sample.depth - 1; frame >= kSkippedFrames; --frame) {
+			// Above the leaf, frames hold return addresses, step back into the call instruction.
+			const char *address = (const char *)sample.frames[frame] - ((frame > kSkippedFrames) ? 1 : 0);
+
+			auto frameName = frameNames.find(address);
+			if (frameName == frameNames.end()) {
+				char name[512];
+
+				Dl_info info;
+				if (dladdr(address, &info) && info.dli_fname && info.dli_fname[0]) {
+					const char *baseName = strrchr(info.dli_fname, '/');
+					baseName = baseName ? baseName + 1 : info.dli_fname;
+
+					snprintf(name, sizeof(name), "%s+0x%zx", baseName, (size_t)(address - (const char *)info.dli_fbase));
+					modules[info.dli_fbase] = { baseName, info.dli_fname };
+				} else {
+					snprintf(name, sizeof(name), "0x%zx", (size_t)address);
+				}
+
+				frameName = frameNames.emplace(address, name).first;
+			}
+
+			if (!stack.empty()) {
+				stack += ';';
+			}
+
+			stack += frameName->second;
+		}
+
+		if (!stack.empty()) {
+			stacks[stack]++;
+		}
+	}
+
+	char timeBuffer[64];
+	time_t now = time(nullptr);
+	struct tm tm;
+	localtime_r(&now, &tm);
+	strftime(timeBuffer, sizeof(timeBuffer), "%Y%m%d-%H%M%S", &tm);
+
+	char path[512];
+	snprintf(path, sizeof(path), "%s/hitch-%s-%ums.folded", m_outputpath.c_str(), timeBuffer, frameMilliseconds);
+
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		return;
+	}
+
+	for (const auto &stack : stacks) {
+		fprintf(file, "%s %u\n", stack.first.c_str(), stack.second);
+	}
+
+	fclose(file);
+
+	snprintf(path, sizeof(path), "%s/hitch-%s-%ums.modules", m_outputpath.c_str(), timeBuffer, frameMilliseconds);
+
+	file = fopen(path, "w");
+	if (file) {
+		for (const auto &module : modules) {
+			std::string debugId;
+			SymbolStore::GetDebugIdentifier(module.second.path, debugId);
+			fprintf(file, "%s %s %s\n", module.second.name.c_str(), debugId.empty() ? "-" : debugId.c_str(), module.second.path.c_str());
+		}
+
+		fclose(file);
+	}
+
+	RemoveOldFiles();
+}
+
+void HitchSampler::RemoveOldFiles()
+{
+	DIR *directory = opendir(m_outputpath.c_str());
+	if (!directory) {
+		return;
+	}
+
+	std::vector<std::string> names;
+	while (struct dirent *entry = readdir(directory)) {
+		size_t length = strlen(entry->d_name);
+		if (length > 7 && strcmp(&entry->d_name[length - 7], ".folded") == 0) {
+			names.emplace_back(entry->d_name, length - 7);
+		}
+	}
+
+	closedir(directory);
+
+	if (names.size() <= m_maxfiles) {
+		return;
+	}
+
+	// Names start with the timestamp, so they sort oldest first.
+	std::sort(names.begin(), names.end());
+	for (size_t i = 0; i < names.size() - m_maxfiles; ++i) {
+		unlink((m_outputpath + "/" + names[i] + ".folded").c_str());
+		unlink((m_outputpath + "/" + names[i] + ".modules").c_str());
+	}
+}
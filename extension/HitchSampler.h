@@ -0,0 +1,77 @@
+#ifndef _INCLUDE_HITCH_SAMPLER_H_
+#define _INCLUDE_HITCH_SAMPLER_H_
+
+#include <atomic>
+#include <chrono>
+#include <pthread.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+#include "PeriodicWorker.h"
+
+/**
+ * @brief Samples the main thread's stack while a game frame runs over budget.
+ *
+ * A helper thread watches the frame heartbeat kept by the upload scheduler. Once the current frame
+ * has run longer than the threshold, it signals the main thread every few milliseconds until the
+ * frame ends. The signal handler records a backtrace into a preallocated slot. When the frame ends,
+ * the samples are folded into a collapsed-stack file (one "root;...;leaf count" line per distinct
+ * stack, frames as module+offset) with a .modules sidecar listing each module's debug identifier,
+ * for offline symbolization and flame graphs.
+ *
+ * The sampler only runs while human players are connected. Each hitch yields at most kMaxSamples
+ * samples, hitches closer together than kMinHitchSpacing are skipped, and frames that stall longer
+ * than kMaxHitchDuration are left to the hang watchdog. Sampling starts at the threshold, so the
+ * samples cover the part of the frame past it.
+ *
+ * core.cfg options:
+ *   MinidumpHitchThreshold  Frame time in milliseconds from which frames are sampled, default 0 (disabled)
+ *   MinidumpHitchFiles      Number of hitch files to keep, default 100
+ */
+class HitchSampler : public PeriodicWorker
+{
+public:
+	static const unsigned int kMaxSamples = 256;
+	static const unsigned int kMaxDepth = 64;
+
+	/**
+	 * @brief Reads the core.cfg options, installs the signal handler and starts the helper thread. Main thread only.
+	 * @return False if the sampler is disabled.
+	 */
+	bool Start(const char *outputPath);
+	/**
+	 * @brief Stops the helper thread and removes the signal handler. Main thread only.
+	 */
+	void Shutdown();
+
+protected: // PeriodicWorker
+	bool Tick();
+
+private:
+	struct Sample {
+		int depth;
+		void *frames[kMaxDepth];
+	};
+
+	static void SignalHandler(int signal, siginfo_t *info, void *context);
+
+	void SampleHitch(std::chrono::steady_clock::time_point frameStart);
+	void WriteCollapsedStacks(unsigned int sampleCount, unsigned int frameMilliseconds);
+	void RemoveOldFiles();
+
+	static std::atomic<Sample *> s_pending; // Slot the signal handler fills next, reset once filled.
+
+	pthread_t m_mainthread;
+	std::chrono::milliseconds m_threshold{0};
+	unsigned int m_maxfiles = 100;
+	std::string m_outputpath;
+	std::vector<Sample> m_samples;
+
+	// Helper thread only.
+	std::chrono::steady_clock::time_point m_lasthitch;
+	std::chrono::steady_clock::time_point m_skippedframe; // Frame already sampled or skipped.
+};
+
+extern HitchSampler g_hitchsampler;
+
+#endif // !_INCLUDE_HITCH_SAMPLER_H_
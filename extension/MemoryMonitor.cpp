@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include "MemoryMonitor.h"
+#include "Breadcrumbs.h"
+#include "UploadLog.h"
+
+#if defined _LINUX
+#include <dlfcn.h>
+#include <unistd.h>
+#elif defined _WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+// Both ends of the trend window are judged by the lowest sample in this many samples, so a
+// short-lived peak such as a map load doesn't look like growth but a rising floor does.
+static const unsigned int kGrowthEdgeSamples = MemoryMonitor::kTrendSamples / 4;
+
+MemoryMonitor g_memorymonitor;
+
+#if defined _LINUX
+// Layout of glibc's struct mallinfo (int fields) and struct mallinfo2 (size_t fields, glibc 2.33).
+// Both are resolved at runtime: linking mallinfo2 would tie the extension to GLIBC_2.33, and newer
+// headers deprecate mallinfo. mallinfo's fields wrap past 4 GiB, it is only used without mallinfo2.
+template <typename T>
+struct MallocInfo {
+	T arena;
+	T ordblks;
+	T smblks;
+	T hblks;
+	T hblkhd;
+	T usmblks;
+	T fsmblks;
+	T uordblks;
+	T fordblks;
+	T keepcost;
+};
+
+typedef MallocInfo<int> (*MallinfoFn)();
+typedef MallocInfo<size_t> (*Mallinfo2Fn)();
+
+static MallinfoFn mallinfoFn = nullptr;
+static Mallinfo2Fn mallinfo2Fn = nullptr;
+#endif
+
+bool MemoryMonitor::Start(WriteMemoryDumpFn writeMemoryDump)
+{
+	const char *limitOption = g_pSM->GetCoreConfigValue("MinidumpMemoryLimit");
+	if (limitOption && atoi(limitOption) > 0) {
+		m_limit = (uint64_t)atoi(limitOption) * 1024 * 1024;
+	}
+
+	const char *growthOption = g_pSM->GetCoreConfigValue("MinidumpMemoryGrowth");
+	if (growthOption && atoi(growthOption) > 0) {
+		m_growth = (uint64_t)atoi(growthOption) * 1024 * 1024;
+	}
+
+	if (m_limit == 0 && m_growth == 0) {
+		return false;
+	}
+
+	const char *intervalOption = g_pSM->GetCoreConfigValue("MinidumpMemoryInterval");
+	if (intervalOption && atoi(intervalOption) > 0) {
+		m_interval = std::chrono::seconds(atoi(intervalOption));
+	}
+
+#if defined _LINUX
+	mallinfo2Fn = (Mallinfo2Fn)dlsym(RTLD_DEFAULT, "mallinfo2");
+	mallinfoFn = (MallinfoFn)dlsym(RTLD_DEFAULT, "mallinfo");
+#endif
+
+	Sample sample;
+	if (!TakeSample(sample)) {
+		return false;
+	}
+
+	// The first sample is taken now, the thread adds the rest.
+	m_samples.push_back(sample);
+
+	m_writememorydump = writeMemoryDump;
+	return StartThread(m_interval);
+}
+
+bool MemoryMonitor::TakeSample(Sample &sample)
+{
+	sample.time = time(nullptr);
+
+#if defined _LINUX
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (!statm) {
+		return false;
+	}
+
+	unsigned long size = 0, resident = 0;
+	int fields = fscanf(statm, "%lu %lu", &size, &resident);
+	fclose(statm);
+
+	if (fields != 2) {
+		return false;
+	}
+
+	sample.resident = (uint64_t)resident * sysconf(_SC_PAGESIZE);
+
+	// In use from the arenas plus chunks mapped on their own.
+	if (mallinfo2Fn) {
+		MallocInfo<size_t> info = mallinfo2Fn();
+		sample.heap = (uint64_t)info.uordblks + (uint64_t)info.hblkhd;
+	} else if (mallinfoFn) {
+		MallocInfo<int> info = mallinfoFn();
+		sample.heap = (uint64_t)(unsigned int)info.uordblks + (uint64_t)(unsigned int)info.hblkhd;
+	} else {
+		sample.heap = 0;
+	}
+#elif defined _WINDOWS
+	PROCESS_MEMORY_COUNTERS_EX counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&counters, sizeof(counters))) {
+		return false;
+	}
+
+	sample.resident = counters.WorkingSetSize;
+	sample.heap = counters.PrivateUsage;
+#endif
+
+	return true;
+}
+
+bool MemoryMonitor::Tick()
+{
+	Sample sample;
+	if (!TakeSample(sample)) {
+		return true;
+	}
+
+	m_samples.push_back(sample);
+	if (m_samples.size() > kTrendSamples) {
+		m_samples.pop_front();
+	}
+
+	char reason[256];
+
+	if (m_limit && sample.resident >= m_limit) {
+		snprintf(reason, sizeof(reason), "Resident memory %u MiB reached the %u MiB limit",
+			(unsigned int)(sample.resident >> 20), (unsigned int)(m_limit >> 20));
+	} else if (m_growth && m_samples.size() == kTrendSamples) {
+		auto lowest = [](const Sample &a, const Sample &b) { return a.resident < b.resident; };
+		const Sample &first = *std::min_element(m_samples.begin(), m_samples.begin() + kGrowthEdgeSamples, lowest);
+		const Sample &last = *std::min_element(m_samples.end() - kGrowthEdgeSamples, m_samples.end(), lowest);
+
+		if (last.resident <= first.resident || last.time <= first.time) {
+			return true;
+		}
+
+		uint64_t growth = (last.resident - first.resident) * 3600 / (last.time - first.time);
+		if (growth < m_growth) {
+			return true;
+		}
+
+		snprintf(reason, sizeof(reason), "Resident memory %u MiB grew by %u MiB per hour over the last %u minutes",
+			(unsigned int)(sample.resident >> 20), (unsigned int)(growth >> 20), (unsigned int)((sample.time - m_samples.front().time) / 60));
+	} else {
+		return true;
+	}
+
+	FormatTrend(reason);
+
+	g_breadcrumbs.Add(kBCMemory, reason);
+
+	bool written = m_writememorydump((unsigned int)(sample.resident >> 20), m_trend);
+	g_uploadlog.Message(nullptr, "%s, %s", reason, written ? "wrote memory dump" : "failed to write memory dump");
+	g_uploadlog.Flush();
+
+	// One dump for the lifetime of the process.
+	return false;
+}
+
+void MemoryMonitor::FormatTrend(const char *reason)
+{
+	size_t length = snprintf(m_trend, sizeof(m_trend), "-------- MEMORY TREND BEGIN --------\nReason=%s\nSeconds Resident(KiB) Heap(KiB)\n", reason);
+
+	const Sample &newest = m_samples.back();
+	for (const Sample &sample : m_samples) {
+		if (length >= sizeof(m_trend)) {
+			break;
+		}
+
+		length += snprintf(&m_trend[length], sizeof(m_trend) - length, "%ld %llu %llu\n",
+			-(long)(newest.time - sample.time), (unsigned long long)(sample.resident >> 10), (unsigned long long)(sample.heap >> 10));
+	}
+
+	if (length < sizeof(m_trend)) {
+		snprintf(&m_trend[length], sizeof(m_trend) - length, "-------- MEMORY TREND END --------\n");
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef _INCLUDE_MEMORY_MONITOR_H_
+#define _INCLUDE_MEMORY_MONITOR_H_
+
+#include <chrono>
+#include <deque>
+#include <stdint.h>
+#include <time.h>
+#include "PeriodicWorker.h"
+
+/**
+ * @brief Writes one minidump of the live process when its memory use points at an upcoming out-of-memory kill.
+ *
+ * The kernel kills an exhausted process with SIGKILL, which no crash handler sees, so slow leaks would
+ * otherwise never reach the crash pipeline. A dedicated thread samples resident memory and heap usage
+ * at a low frequency and keeps the last kTrendSamples samples. Once resident memory crosses the limit,
+ * or has grown faster than the configured rate across a full trend window, it writes a single dump for
+ * the lifetime of the process, with the trend in its metadata.
+ *
+ * Heap usage is what the allocator has handed out on Linux, and the private commit on Windows.
+ *
+ * core.cfg options:
+ *   MinidumpMemoryLimit     Resident memory in MiB from which a dump is written, default 0 (disabled)
+ *   MinidumpMemoryGrowth    Growth in MiB per hour, sustained across the trend window, from which a dump is written, default 0 (disabled)
+ *   MinidumpMemoryInterval  Seconds between samples, default 60
+ */
+class MemoryMonitor : public PeriodicWorker
+{
+public:
+	static const unsigned int kTrendSamples = 60;
+
+	/**
+	 * @brief Writes the dump.
+	 * @param residentMegabytes Resident memory when the dump was triggered.
+	 * @param trend Preformatted metadata section describing the trigger and the samples.
+	 */
+	typedef bool (*WriteMemoryDumpFn)(unsigned int residentMegabytes, const char *trend);
+
+	/**
+	 * @brief Reads the core.cfg options and starts the monitor thread. Main thread only.
+	 * @return False if the monitor is disabled.
+	 */
+	bool Start(WriteMemoryDumpFn writeMemoryDump);
+
+protected: // PeriodicWorker
+	bool Tick();
+
+private:
+	struct Sample {
+		time_t time;
+		uint64_t resident; // Bytes.
+		uint64_t heap; // Bytes.
+	};
+
+	static bool TakeSample(Sample &sample);
+
+	void FormatTrend(const char *reason);
+
+	WriteMemoryDumpFn m_writememorydump = nullptr;
+	uint64_t m_limit = 0; // Bytes.
+	uint64_t m_growth = 0; // Bytes per hour.
+	std::chrono::seconds m_interval{60};
+
+	// Monitor thread only.
+	std::deque<Sample> m_samples;
+	char m_trend[4096];
+};
+
+extern MemoryMonitor g_memorymonitor;
+
+#endif // !_INCLUDE_MEMORY_MONITOR_H_
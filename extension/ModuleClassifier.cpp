@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+#include "ModuleClassifier.h"
+
+#ifndef WIN32
+#define PATH_SEP "/"
+#else
+#define PATH_SEP "\\"
+#endif
+
+const char *ModuleTypeCode[5] = {
+	"Unknown",
+	"System",
+	"Game",
+	"Addon",
+	"Extension",
+};
+
+static bool PathPrefixMatches(const std::string &prefix, const std::string &path)
+{
+#ifndef WIN32
+	return strncmp(prefix.c_str(), path.c_str(), prefix.length()) == 0;
+#else
+	return _strnicmp(prefix.c_str(), path.c_str(), prefix.length()) == 0;
+#endif
+}
+
+bool ModuleClassifier::PathComparator::compare::operator() (const unsigned char &a, const unsigned char &b) const
+{
+#ifndef WIN32
+	return a < b;
+#else
+	return tolower(a) < tolower(b);
+#endif
+}
+
+bool ModuleClassifier::PathComparator::operator() (const std::string &a, const std::string &b) const
+{
+	return !std::lexicographical_compare(
+		a.begin(), a.end(),
+		b.begin(), b.end(),
+		compare());
+}
+
+void ModuleClassifier::Init(const std::string &base, const std::string &gamePath, const std::string &sourceModPath)
+{
+	if (!m_modulepathmap.empty()) {
+		m_modulepathmap.clear();
+	}
+
+	m_modulepathmap[base] = kMTGame;
+	m_modulepathmap[gamePath + PATH_SEP "addons" PATH_SEP] = kMTAddon;
+	m_modulepathmap[sourceModPath + PATH_SEP "extensions" PATH_SEP] = kMTExtension;
+}
+
+ModuleType ModuleClassifier::Classify(const std::string &codeFile) const
+{
+	if (m_modulepathmap.empty()) {
+		return kMTUnknown;
+	}
+
+#ifndef WIN32
+	if (codeFile == "linux-gate.so") {
+		return kMTSystem;
+	}
+
+	if (codeFile[0] != '/') {
+#else
+	if (codeFile[1] != ':') {
+#endif
+		return kMTUnknown;
+	}
+
+	for (auto i = m_modulepathmap.begin(); i != m_modulepathmap.end(); ++i) {
+		if (PathPrefixMatches(i->first, codeFile)) {
+			return i->second;
+		}
+	}
+
+	return kMTSystem;
+}
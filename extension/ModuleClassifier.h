@@ -0,0 +1,49 @@
+#ifndef _INCLUDE_MODULE_CLASSIFIER_H_
+#define _INCLUDE_MODULE_CLASSIFIER_H_
+
+#include <map>
+#include <string>
+
+enum ModuleType {
+	kMTUnknown,
+	kMTSystem,
+	kMTGame,
+	kMTAddon,
+	kMTExtension,
+};
+
+extern const char *ModuleTypeCode[5];
+
+/**
+ * @brief Sorts loaded modules into system, game, addon and extension buckets based on their path.
+ */
+class ModuleClassifier
+{
+public:
+	/**
+	 * @brief Builds the path prefix map used by Classify.
+	 * @param base Directory containing the main executable.
+	 * @param gamePath Game directory (crashGamePath).
+	 * @param sourceModPath SourceMod directory (crashSourceModPath).
+	 */
+	void Init(const std::string &base, const std::string &gamePath, const std::string &sourceModPath);
+	/**
+	 * @brief Classifies a module by its code file path.
+	 * @param codeFile Full path of the module's code file.
+	 * @return Module type, or kMTUnknown if Init has not been called.
+	 */
+	ModuleType Classify(const std::string &codeFile) const;
+
+private:
+	struct PathComparator {
+		struct compare {
+			bool operator() (const unsigned char &a, const unsigned char &b) const;
+		};
+
+		bool operator() (const std::string &a, const std::string &b) const;
+	};
+
+	std::map<std::string, ModuleType, PathComparator> m_modulepathmap;
+};
+
+#endif // !_INCLUDE_MODULE_CLASSIFIER_H_
@@ -0,0 +1,41 @@
+#include "PeriodicWorker.h"
+
+bool PeriodicWorker::StartThread(std::chrono::steady_clock::duration interval)
+{
+	m_interval = interval;
+	m_shutdown = false;
+	m_thread = threader->MakeThread(this, Thread_Default);
+	return m_thread != nullptr;
+}
+
+void PeriodicWorker::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+
+	m_wakeup.notify_all();
+
+	if (m_thread) {
+		m_thread->WaitForThread();
+		m_thread->DestroyThis();
+		m_thread = nullptr;
+	}
+}
+
+bool PeriodicWorker::WaitFor(std::chrono::steady_clock::duration duration)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	return !m_wakeup.wait_for(lock, duration, [this] { return m_shutdown; });
+}
+
+void PeriodicWorker::RunThread(IThreadHandle *pHandle)
+{
+	while (WaitFor(m_interval) && Tick()) {
+	}
+}
+
+void PeriodicWorker::OnTerminate(IThreadHandle *pHandle, bool cancel)
+{
+}
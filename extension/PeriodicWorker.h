@@ -0,0 +1,53 @@
+#ifndef _INCLUDE_PERIODIC_WORKER_H_
+#define _INCLUDE_PERIODIC_WORKER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "smsdk_ext.h"
+
+/**
+ * @brief Dedicated thread that calls Tick at a fixed interval until it returns false or is shut down.
+ *
+ * Base for the monitors that must keep running when the main thread and the service thread don't,
+ * so they can't be tasks on either.
+ */
+class PeriodicWorker : public IThread
+{
+public:
+	/**
+	 * @brief Wakes the thread and waits for it to exit. Main thread only.
+	 */
+	void Shutdown();
+
+public: // IThread
+	void RunThread(IThreadHandle *pHandle);
+	void OnTerminate(IThreadHandle *pHandle, bool cancel);
+
+protected:
+	/**
+	 * @brief Starts the thread, the first Tick comes one interval later. Main thread only.
+	 */
+	bool StartThread(std::chrono::steady_clock::duration interval);
+	bool IsRunning() const { return m_thread != nullptr; }
+
+	/**
+	 * @brief Called on the worker thread once per interval.
+	 * @return False to stop the thread.
+	 */
+	virtual bool Tick() = 0;
+	/**
+	 * @brief Sleeps, waking early for Shutdown. Worker thread only.
+	 * @return False if shutting down.
+	 */
+	bool WaitFor(std::chrono::steady_clock::duration duration);
+
+private:
+	std::chrono::steady_clock::duration m_interval;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	bool m_shutdown = false;
+	IThreadHandle *m_thread = nullptr;
+};
+
+#endif // !_INCLUDE_PERIODIC_WORKER_H_
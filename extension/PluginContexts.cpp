@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <string.h>
+#include "PluginContexts.h"
+
+/* 010 Editor Template
+uint64 headerMagic;
+uint32 version;
+uint32 size;
+uint32 count;
+struct {
+    uint32 size;
+    uint32 context <format=hex>;
+    char file[];
+    uint32 count;
+    struct {
+        uint32 pcode <format=hex>;
+        char name[];
+    } functions[count] <optimize=false>;
+} plugins[count] <optimize=false>;
+uint64 tailMagic;
+*/
+
+unsigned char *SerializePluginContextMap(const PluginContextMap &pluginContextMap, uint32_t &size)
+{
+	uint32_t count = pluginContextMap.size();
+	if (count == 0) {
+		return nullptr;
+	}
+
+	size = 0;
+	size += sizeof(uint64_t); // header magic
+	size += sizeof(uint32_t); // version
+	size += sizeof(uint32_t); // size
+	size += sizeof(uint32_t); // count
+
+	for (auto &it : pluginContextMap) {
+		unsigned char *buffer = it.second;
+
+		uint32_t bufferSize;
+		memcpy(&bufferSize, buffer, sizeof(uint32_t));
+
+		size += bufferSize;
+	}
+
+	size += sizeof(uint64_t); // tail magic
+
+	unsigned char *serialized = (unsigned char *)malloc(size);
+	unsigned char *cursor = serialized;
+
+	uint64_t headerMagic = 103582791429521979ULL;
+	memcpy(cursor, &headerMagic, sizeof(uint64_t));
+	cursor += sizeof(uint64_t);
+
+	uint32_t version = 1;
+	memcpy(cursor, &version, sizeof(uint32_t));
+	cursor += sizeof(uint32_t);
+
+	memcpy(cursor, &size, sizeof(uint32_t));
+	cursor += sizeof(uint32_t);
+
+	memcpy(cursor, &count, sizeof(uint32_t));
+	cursor += sizeof(uint32_t);
+
+	for (auto &it : pluginContextMap) {
+		unsigned char *buffer = it.second;
+
+		uint32_t bufferSize;
+		memcpy(&bufferSize, buffer, sizeof(uint32_t));
+
+		memcpy(cursor, buffer, bufferSize);
+		cursor += bufferSize;
+	}
+
+	uint64_t tailMagic = 76561197987819599ULL;
+	memcpy(cursor, &tailMagic, sizeof(uint64_t));
+	cursor += sizeof(uint64_t);
+
+	return serialized;
+}
@@ -0,0 +1,22 @@
+#ifndef _INCLUDE_PLUGIN_CONTEXTS_H_
+#define _INCLUDE_PLUGIN_CONTEXTS_H_
+
+#include <map>
+#include <stdint.h>
+
+namespace SourcePawn {
+	class IPluginContext;
+}
+
+// Per-plugin buffers (as built in Accelerator::OnPluginLoaded) keyed by the plugin's base context.
+typedef std::map<const SourcePawn::IPluginContext *, unsigned char *> PluginContextMap;
+
+/**
+ * @brief Serializes all plugin context buffers into a single blob suitable for registering as app memory.
+ * @param pluginContextMap Per-plugin buffers to serialize.
+ * @param size Receives the size of the returned blob.
+ * @return malloc'd blob (caller frees), or nullptr if there are no plugins.
+ */
+unsigned char *SerializePluginContextMap(const PluginContextMap &pluginContextMap, uint32_t &size);
+
+#endif // !_INCLUDE_PLUGIN_CONTEXTS_H_
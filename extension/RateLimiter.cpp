@@ -0,0 +1,54 @@
+#include <thread>
+#include "RateLimiter.h"
+
+void RateLimiter::Configure(uint64_t bytesPerSecond, uint64_t burst)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_rate = bytesPerSecond;
+	m_burst = static_cast<double>(burst ? burst : bytesPerSecond);
+	m_tokens = m_burst;
+	m_lastrefill = std::chrono::steady_clock::now();
+}
+
+bool RateLimiter::Allows(uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_rate == 0 || static_cast<double>(bytes) <= m_burst;
+}
+
+uint64_t RateLimiter::Acquire(uint64_t bytes)
+{
+	double deficit;
+	uint64_t rate;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_rate == 0) {
+			return 0;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(now - m_lastrefill).count();
+		m_lastrefill = now;
+
+		m_tokens += elapsed * m_rate;
+		if (m_tokens > m_burst) {
+			m_tokens = m_burst;
+		}
+
+		m_tokens -= static_cast<double>(bytes);
+		if (m_tokens >= 0) {
+			return 0;
+		}
+
+		deficit = -m_tokens;
+		rate = m_rate;
+	}
+
+	// The tokens are already taken, so sleep outside the lock and let other callers queue up behind us.
+	auto wait = std::chrono::microseconds(static_cast<uint64_t>((deficit / rate) * 1000000.0));
+	std::this_thread::sleep_for(wait);
+
+	return wait.count();
+}
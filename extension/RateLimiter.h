@@ -0,0 +1,48 @@
+#ifndef _INCLUDE_RATE_LIMITER_H_
+#define _INCLUDE_RATE_LIMITER_H_
+
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+
+/**
+ * @brief Token bucket limiting the average byte rate of uploads.
+ *
+ * Callers debit the bucket by the size of what they are about to send and sleep off any deficit
+ * before sending it. Only the spacing of requests is limited, each request still goes out at link
+ * speed, so a body larger than the burst would exceed the intended peak and is refused instead.
+ *
+ * core.cfg options:
+ *   MinidumpUploadRate   Sustained upload rate in bytes per second, default 0 (unlimited)
+ *   MinidumpUploadBurst  Largest single request in bytes, default one second worth of the rate.
+ *                        The peak within a request is not limited, larger uploads are not sent.
+ */
+class RateLimiter
+{
+public:
+	/**
+	 * @brief Sets the limit. A rate of 0 disables limiting.
+	 * @param bytesPerSecond Sustained rate.
+	 * @param burst Bucket size, the number of bytes that can be sent at once after an idle period.
+	 */
+	void Configure(uint64_t bytesPerSecond, uint64_t burst);
+	/**
+	 * @brief Checks that a request of the given size fits in the burst. (thread safe)
+	 * @return False if limiting is enabled and the request is larger than the burst.
+	 */
+	bool Allows(uint64_t bytes);
+	/**
+	 * @brief Takes tokens for the given number of bytes, sleeping until the bucket is no longer in deficit.
+	 * @return Time spent sleeping, in microseconds.
+	 */
+	uint64_t Acquire(uint64_t bytes);
+
+private:
+	std::mutex m_mutex;
+	uint64_t m_rate = 0;
+	double m_burst = 0;
+	double m_tokens = 0;
+	std::chrono::steady_clock::time_point m_lastrefill;
+};
+
+#endif // !_INCLUDE_RATE_LIMITER_H_
@@ -0,0 +1,43 @@
+#ifndef _INCLUDE_REALTIME_SIGNALS_H_
+#define _INCLUDE_REALTIME_SIGNALS_H_
+
+#include <signal.h>
+#include <string.h>
+
+// Realtime signals sent to the main thread with pthread_kill, SIGRTMAX isn't a constant in glibc.
+// Neither is assumed to be free, see ClaimRealtimeSignal.
+#define HANG_DUMP_SIGNAL (SIGRTMAX - 2)
+#define HITCH_SAMPLE_SIGNAL (SIGRTMAX - 3)
+
+/**
+ * @brief Installs a handler for one of the signals above, only if nothing else has one for it.
+ * @return False if the signal is already handled or ignored, the caller should not start then.
+ */
+inline bool ClaimRealtimeSignal(int signal, void (*handler)(int, siginfo_t *, void *))
+{
+	struct sigaction current;
+	if (sigaction(signal, NULL, &current) != 0 || (current.sa_flags & SA_SIGINFO) || current.sa_handler != SIG_DFL) {
+		return false;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	sigemptyset(&action.sa_mask);
+	action.sa_sigaction = handler;
+	action.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+	return sigaction(signal, &action, NULL) == 0;
+}
+
+/**
+ * @brief Puts a claimed signal back to its default disposition, before the handler is unloaded.
+ */
+inline void ReleaseRealtimeSignal(int signal)
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	sigemptyset(&action.sa_mask);
+	action.sa_handler = SIG_DFL;
+	sigaction(signal, &action, NULL);
+}
+
+#endif // !_INCLUDE_REALTIME_SIGNALS_H_
@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Sandbox.h"
+#include "UploadLog.h"
+#include "smsdk_ext.h"
+
+// Result header the child writes ahead of the output.
+enum SandboxStatus : uint8_t {
+	kSBFailed,
+	kSBSucceeded,
+	kSBOutOfMemory,
+};
+
+struct SandboxHeader {
+	uint8_t status;
+	uint64_t size;
+};
+
+// The child runs at the service thread's lowered priority, give it more wall time than CPU time.
+static const unsigned int kWallTimeFactor = 4;
+
+#define IOPRIO_WHO_PROCESS 1
+
+Sandbox g_sandbox;
+
+static bool WriteAll(int fd, const char *data, size_t size)
+{
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return false;
+		}
+
+		data += written;
+		size -= written;
+	}
+
+	return true;
+}
+
+static uint64_t GetAddressSpaceSize()
+{
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (!statm) {
+		return 0;
+	}
+
+	unsigned long size = 0;
+	if (fscanf(statm, "%lu", &size) != 1) {
+		size = 0;
+	}
+
+	fclose(statm);
+	return (uint64_t)size * sysconf(_SC_PAGESIZE);
+}
+
+void Sandbox::Init()
+{
+	const char *enabledOption = g_pSM->GetCoreConfigValue("MinidumpSandbox");
+	m_enabled = !enabledOption || (tolower(enabledOption[0]) == 'y' || enabledOption[0] == '1');
+
+	const char *memoryOption = g_pSM->GetCoreConfigValue("MinidumpSandboxMemory");
+	if (memoryOption && atoi(memoryOption) > 0) {
+		m_memory = (uint64_t)atoi(memoryOption) * 1024 * 1024;
+	}
+
+	const char *timeOption = g_pSM->GetCoreConfigValue("MinidumpSandboxTime");
+	if (timeOption && atoi(timeOption) > 0) {
+		m_cpuseconds = atoi(timeOption);
+	}
+
+	if (m_enabled) {
+		m_thread = threader->MakeThread(this, Thread_Default);
+	}
+}
+
+void Sandbox::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+
+	m_wakeup.notify_all();
+
+	if (m_thread) {
+		m_thread->WaitForThread();
+		m_thread->DestroyThis();
+		m_thread = nullptr;
+	}
+}
+
+void Sandbox::RunThread(IThreadHandle *pHandle)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (;;) {
+		m_wakeup.wait(lock, [this] { return m_shutdown || (m_request && !m_request->done); });
+
+		if (m_shutdown) {
+			return;
+		}
+
+		// Not held across the fork, the child would inherit it locked.
+		ForkRequest *request = m_request;
+		request->started = true;
+		lock.unlock();
+		pid_t child = ForkChild(*request);
+		lock.lock();
+
+		request->child = child;
+		request->done = true;
+		m_wakeup.notify_all();
+	}
+}
+
+void Sandbox::OnTerminate(IThreadHandle *pHandle, bool cancel)
+{
+}
+
+pid_t Sandbox::Fork(const Task &task, const int fds[2])
+{
+	ForkRequest request = { &task, fds, sched_getscheduler(0), (int)syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0), false, false, -1 };
+
+	// Without the fork thread, fork from here and put up with the priority the caller has.
+	if (!m_thread) {
+		return ForkChild(request);
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_wakeup.wait(lock, [this] { return m_shutdown || !m_request; });
+	if (m_shutdown) {
+		return -1;
+	}
+
+	m_request = &request;
+	m_wakeup.notify_all();
+
+	// Once the fork has started it is seen through, shutdown waits for the fork thread.
+	m_wakeup.wait(lock, [&] { return request.done || (m_shutdown && !request.started); });
+	m_request = nullptr;
+	m_wakeup.notify_all();
+	return request.done ? request.child : -1;
+}
+
+pid_t Sandbox::ForkChild(const ForkRequest &request)
+{
+	pid_t child = fork();
+	if (child != 0) {
+		return child;
+	}
+
+	close(request.fds[0]);
+
+	// Back to the caller's priority, lowering it needs no privileges.
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	sched_setscheduler(0, request.policy, &param);
+	if (request.ioprio >= 0) {
+		syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, request.ioprio);
+	}
+
+	RunChild(*request.task, request.fds[1]);
+}
+
+bool Sandbox::Run(const char *name, const Task &task, std::string &output)
+{
+	if (!m_enabled) {
+		return task(output);
+	}
+
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) != 0) {
+		g_uploadlog.Message(nullptr, "Failed to create the sandbox pipe for %s", name);
+		return false;
+	}
+
+	pid_t child = Fork(task, fds);
+	close(fds[1]);
+
+	if (child == -1) {
+		close(fds[0]);
+		g_uploadlog.Message(nullptr, "Failed to start the sandbox for %s", name);
+		return false;
+	}
+
+	uint8_t status = kSBFailed;
+	bool received = Receive(fds[0], output, status);
+	close(fds[0]);
+
+	if (!received) {
+		kill(child, SIGKILL);
+	}
+
+	// Fails with ECHILD when the game ignores SIGCHLD, the header already says how it went then.
+	int exitStatus = 0;
+	pid_t waited;
+	while ((waited = waitpid(child, &exitStatus, 0)) == -1 && errno == EINTR) {
+	}
+
+	if (received) {
+		if (status == kSBOutOfMemory) {
+			g_uploadlog.Message(nullptr, "Sandboxed %s ran out of memory", name);
+		}
+
+		return status == kSBSucceeded;
+	}
+
+	output.clear();
+
+	if (waited == child && WIFSIGNALED(exitStatus)) {
+		int signal = WTERMSIG(exitStatus);
+		if (signal == SIGXCPU) {
+			g_uploadlog.Message(nullptr, "Sandboxed %s ran out of CPU time", name);
+		} else if (signal == SIGKILL) {
+			g_uploadlog.Message(nullptr, "Sandboxed %s timed out", name);
+		} else {
+			g_uploadlog.Message(nullptr, "Sandboxed %s crashed with signal %d", name, signal);
+		}
+	} else {
+		g_uploadlog.Message(nullptr, "Sandboxed %s exited without a result", name);
+	}
+
+	return false;
+}
+
+void Sandbox::RunChild(const Task &task, int fd)
+{
+	// A crash in here is the task's failure, not a server crash to dump and upload. Every signal breakpad
+	// handles, SIGTRAP included, plus SIGXCPU for the CPU limit.
+	static const int kResetSignals[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL, SIGBUS, SIGTRAP, SIGXCPU };
+	for (int signal : kResetSignals) {
+		::signal(signal, SIG_DFL);
+	}
+
+	struct rlimit limit;
+	limit.rlim_cur = limit.rlim_max = GetAddressSpaceSize() + m_memory;
+	setrlimit(RLIMIT_AS, &limit);
+
+	// SIGXCPU at the soft limit, SIGKILL a little later if it is caught.
+	limit.rlim_cur = m_cpuseconds;
+	limit.rlim_max = m_cpuseconds + 5;
+	setrlimit(RLIMIT_CPU, &limit);
+
+	// Core files from the child would only be mistaken for crashes of their own.
+	limit.rlim_cur = limit.rlim_max = 0;
+	setrlimit(RLIMIT_CORE, &limit);
+
+	std::string output;
+	SandboxHeader header = { kSBFailed, 0 };
+
+	try {
+		if (task(output)) {
+			header.status = kSBSucceeded;
+			header.size = output.size();
+		}
+	} catch (const std::bad_alloc &) {
+		header.status = kSBOutOfMemory;
+	}
+
+	if (WriteAll(fd, (const char *)&header, sizeof(header))) {
+		WriteAll(fd, output.data(), header.size);
+	}
+
+	// Skip the game's atexit handlers and destructors, they belong to the parent.
+	_exit(0);
+}
+
+bool Sandbox::Receive(int fd, std::string &output, uint8_t &status)
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_cpuseconds * kWallTimeFactor);
+
+	SandboxHeader header;
+	size_t headerReceived = 0;
+	output.clear();
+
+	for (;;) {
+		bool haveHeader = headerReceived == sizeof(header);
+		if (haveHeader && output.size() == header.size) {
+			status = header.status;
+			return true;
+		}
+
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		if (remaining <= 0) {
+			return false;
+		}
+
+		// Unload waits for the service thread, give up on the child rather than hold it until the deadline.
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_shutdown) {
+				return false;
+			}
+		}
+
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		int ready = poll(&pfd, 1, (int)std::min<int64_t>(remaining, 1000));
+		if (ready < 0 && errno != EINTR) {
+			return false;
+		}
+
+		if (ready <= 0) {
+			continue;
+		}
+
+		char buffer[64 * 1024];
+		size_t wanted = haveHeader ? std::min<uint64_t>(sizeof(buffer), header.size - output.size()) : sizeof(header) - headerReceived;
+		ssize_t received = read(fd, buffer, wanted);
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+
+		// The child exited or crashed before sending everything.
+		if (received <= 0) {
+			return false;
+		}
+
+		if (haveHeader) {
+			output.append(buffer, received);
+		} else {
+			memcpy((char *)&header + headerReceived, buffer, received);
+			headerReceived += received;
+
+			if (headerReceived == sizeof(header)) {
+				output.reserve(header.size);
+			}
+		}
+	}
+}
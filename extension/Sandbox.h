@@ -0,0 +1,91 @@
+#ifndef _INCLUDE_SANDBOX_H_
+#define _INCLUDE_SANDBOX_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include "smsdk_ext.h"
+
+/**
+ * @brief Runs heavy, crash-prone work in a short-lived forked child under memory and CPU limits.
+ *
+ * Minidump processing and symbol generation parse untrusted input and can allocate gigabytes. In
+ * a child, a crash or runaway allocation only takes the child down, and the memory it used goes
+ * back to the system when it exits instead of staying in the game process's heap. Only the task's
+ * output comes back, over a pipe.
+ *
+ * The child starts with a copy of the parent's address space, the memory limit is on top of that.
+ * Crash handlers are reset in the child, so a crash in it is never reported as a server crash.
+ *
+ * Forking copies the page tables of the whole server while holding locks the game thread needs, so
+ * it isn't done from the idle priority service thread, where any busy thread could preempt it with
+ * those locks held. A fork thread started at load at normal priority forks on its behalf, and the
+ * child then drops back to the caller's CPU and I/O priority.
+ *
+ * core.cfg options:
+ *   MinidumpSandbox        "yes" (default) to run tasks in a child, "no" to run them in-process
+ *   MinidumpSandboxMemory  MiB of address space the child may map beyond what it inherits, default 1024
+ *   MinidumpSandboxTime    CPU seconds the child may use, default 300
+ */
+class Sandbox : public IThread
+{
+public:
+	/**
+	 * @brief Work to run in the child.
+	 * @param output Receives the result sent back to the parent.
+	 * @return False if the task failed.
+	 */
+	typedef std::function<bool(std::string &output)> Task;
+
+	/**
+	 * @brief Reads the core.cfg options and starts the fork thread. Main thread only.
+	 */
+	void Init();
+	/**
+	 * @brief Stops the fork thread, a Run in progress fails and kills its child. Main thread only.
+	 */
+	void Shutdown();
+	/**
+	 * @brief Runs the task, in a child unless the sandbox is disabled, and waits for it to finish.
+	 * @param name Describes the task in the upload log.
+	 * @return False if the task failed, crashed or ran out of its limits.
+	 */
+	bool Run(const char *name, const Task &task, std::string &output);
+
+public: // IThread
+	void RunThread(IThreadHandle *pHandle);
+	void OnTerminate(IThreadHandle *pHandle, bool cancel);
+
+private:
+	struct ForkRequest {
+		const Task *task;
+		const int *fds; // Pipe, the child writes the second.
+		int policy; // Caller's scheduling policy and I/O priority, for the child.
+		int ioprio;
+		bool started;
+		bool done;
+		pid_t child;
+	};
+
+	pid_t Fork(const Task &task, const int fds[2]);
+	pid_t ForkChild(const ForkRequest &request);
+	[[noreturn]] void RunChild(const Task &task, int fd);
+	bool Receive(int fd, std::string &output, uint8_t &status);
+
+	bool m_enabled = true;
+	uint64_t m_memory = 1024ULL * 1024 * 1024; // Bytes.
+	unsigned int m_cpuseconds = 300;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	ForkRequest *m_request = nullptr;
+	bool m_shutdown = false;
+	IThreadHandle *m_thread = nullptr;
+};
+
+extern Sandbox g_sandbox;
+
+#endif // !_INCLUDE_SANDBOX_H_
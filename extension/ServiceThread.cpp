@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ServiceThread.h"
+
+#if defined _LINUX
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+static cpu_set_t mainThreadAffinity;
+#elif defined _WINDOWS
+#include <windows.h>
+
+static DWORD_PTR mainThreadAffinity = 0;
+static DWORD_PTR systemAffinity = 0;
+#endif
+
+ServiceThread g_servicethread;
+
+void ServiceThread::Start()
+{
+#if defined _LINUX
+	CPU_ZERO(&mainThreadAffinity);
+	sched_getaffinity(0, sizeof(mainThreadAffinity), &mainThreadAffinity);
+#elif defined _WINDOWS
+	GetProcessAffinityMask(GetCurrentProcess(), &mainThreadAffinity, &systemAffinity);
+#endif
+
+	m_thread = threader->MakeThread(this, Thread_Default);
+}
+
+void ServiceThread::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+		m_tasks.clear();
+		m_delayed.clear();
+	}
+
+	m_wakeup.notify_all();
+
+	// The current task may be an upload, it runs extension code until it is done.
+	if (m_thread) {
+		m_thread->WaitForThread();
+		m_thread->DestroyThis();
+		m_thread = nullptr;
+	}
+}
+
+bool ServiceThread::Post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_shutdown) {
+			return false;
+		}
+
+		m_tasks.push_back(std::move(task));
+	}
+
+	m_wakeup.notify_one();
+	return true;
+}
+
+bool ServiceThread::PostDelayed(std::function<void()> task, std::chrono::steady_clock::duration delay)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_shutdown) {
+			return false;
+		}
+
+		m_delayed.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+	}
+
+	m_wakeup.notify_one();
+	return true;
+}
+
+bool ServiceThread::WaitFor(std::chrono::steady_clock::duration duration)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	return !m_wakeup.wait_for(lock, duration, [this] { return m_shutdown; });
+}
+
+void ServiceThread::RunThread(IThreadHandle *pHandle)
+{
+	ApplySchedulingPolicy();
+
+	for (;;) {
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			for (;;) {
+				if (m_shutdown) {
+					return;
+				}
+
+				// Due delayed tasks join the back of the queue.
+				auto now = std::chrono::steady_clock::now();
+				while (!m_delayed.empty() && m_delayed.begin()->first <= now) {
+					m_tasks.push_back(std::move(m_delayed.begin()->second));
+					m_delayed.erase(m_delayed.begin());
+				}
+
+				if (!m_tasks.empty()) {
+					break;
+				}
+
+				if (m_delayed.empty()) {
+					m_wakeup.wait(lock);
+				} else {
+					m_wakeup.wait_until(lock, m_delayed.begin()->first);
+				}
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		task();
+	}
+}
+
+void ServiceThread::OnTerminate(IThreadHandle *pHandle, bool cancel)
+{
+}
+
+void ServiceThread::ApplySchedulingPolicy()
+{
+	const char *priorityOption = g_pSM->GetCoreConfigValue("MinidumpServicePriority");
+	bool lowPriority = !priorityOption || strcmp(priorityOption, "normal") != 0;
+
+	const char *affinityOption = g_pSM->GetCoreConfigValue("MinidumpServiceAffinity");
+	if (affinityOption && !affinityOption[0]) {
+		affinityOption = nullptr;
+	}
+
+#if defined _LINUX
+	if (lowPriority) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		if (sched_setscheduler(0, SCHED_IDLE, &param) != 0) {
+			g_pSM->LogError(myself, "Failed to set service thread CPU priority to idle");
+		}
+
+		// Without a thread id, ioprio_set applies to the calling thread only.
+		if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+			g_pSM->LogError(myself, "Failed to set service thread I/O priority to idle");
+		}
+	}
+
+	if (!affinityOption) {
+		return;
+	}
+
+	cpu_set_t affinity;
+	CPU_ZERO(&affinity);
+
+	if (strcmp(affinityOption, "auto") == 0) {
+		// An unpinned game thread moves between CPUs, there is no core of its own to keep off.
+		long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+		if (CPU_COUNT(&mainThreadAffinity) >= cpuCount) {
+			smutils->LogMessage(myself, "MinidumpServiceAffinity \"auto\" has no effect, the game thread isn't pinned to any CPUs");
+			return;
+		}
+
+		for (long cpu = 0; cpu < cpuCount && cpu < CPU_SETSIZE; ++cpu) {
+			if (!CPU_ISSET(cpu, &mainThreadAffinity)) {
+				CPU_SET(cpu, &affinity);
+			}
+		}
+	} else {
+		const char *cursor = affinityOption;
+		while (*cursor) {
+			char *end;
+			long cpu = strtol(cursor, &end, 10);
+			if (end == cursor) {
+				break;
+			}
+
+			if (cpu >= 0 && cpu < CPU_SETSIZE) {
+				CPU_SET(cpu, &affinity);
+			}
+
+			cursor = (*end == ',') ? end + 1 : end;
+		}
+	}
+
+	if (CPU_COUNT(&affinity) == 0 || sched_setaffinity(0, sizeof(affinity), &affinity) != 0) {
+		g_pSM->LogError(myself, "Failed to apply MinidumpServiceAffinity \"%s\"", affinityOption);
+	}
+#elif defined _WINDOWS
+	if (lowPriority) {
+		// Lowers both CPU and I/O priority for this thread.
+		if (!SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN)) {
+			g_pSM->LogError(myself, "Failed to set service thread to background mode");
+		}
+	}
+
+	if (!affinityOption) {
+		return;
+	}
+
+	DWORD_PTR affinity = 0;
+
+	if (strcmp(affinityOption, "auto") == 0) {
+		// An unpinned game thread moves between CPUs, there is no core of its own to keep off.
+		if (mainThreadAffinity == systemAffinity) {
+			smutils->LogMessage(myself, "MinidumpServiceAffinity \"auto\" has no effect, the game thread isn't pinned to any CPUs");
+			return;
+		}
+
+		affinity = systemAffinity & ~mainThreadAffinity;
+	} else {
+		const char *cursor = affinityOption;
+		while (*cursor) {
+			char *end;
+			long cpu = strtol(cursor, &end, 10);
+			if (end == cursor) {
+				break;
+			}
+
+			if (cpu >= 0 && cpu < (long)(sizeof(DWORD_PTR) * 8)) {
+				affinity |= (DWORD_PTR)1 << cpu;
+			}
+
+			cursor = (*end == ',') ? end + 1 : end;
+		}
+	}
+
+	if (affinity == 0 || !SetThreadAffinityMask(GetCurrentThread(), affinity)) {
+		g_pSM->LogError(myself, "Failed to apply MinidumpServiceAffinity \"%s\"", affinityOption);
+	}
+#endif
+}
@@ -0,0 +1,67 @@
+#ifndef _INCLUDE_SERVICE_THREAD_H_
+#define _INCLUDE_SERVICE_THREAD_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include "smsdk_ext.h"
+
+/**
+ * @brief Single background thread that runs all of the extension's deferred work in order.
+ *
+ * The thread lowers its own CPU and I/O scheduling priority when it starts and can be kept off
+ * the game thread's core, configured with the following core.cfg options:
+ *
+ *   MinidumpServicePriority  "idle" (default) or "normal"
+ *   MinidumpServiceAffinity  "" (default, no change), "auto" (every CPU the game thread isn't pinned to,
+ *                            no effect if it isn't pinned)
+ *                            or a comma separated CPU list such as "2,3"
+ */
+class ServiceThread : public IThread
+{
+public:
+	/**
+	 * @brief Starts the thread. Must be called from the main thread.
+	 */
+	void Start();
+	/**
+	 * @brief Stops accepting tasks, wakes the thread and waits for it to exit after the current task. Main thread only.
+	 */
+	void Shutdown();
+	/**
+	 * @brief Queues a task to run on the service thread. (thread safe)
+	 * @return False if the thread is shutting down and the task was dropped.
+	 */
+	bool Post(std::function<void()> task);
+	/**
+	 * @brief Queues a task to run on the service thread once the delay has passed. (thread safe)
+	 * @return False if the thread is shutting down and the task was dropped.
+	 */
+	bool PostDelayed(std::function<void()> task, std::chrono::steady_clock::duration delay);
+	/**
+	 * @brief Sleeps, waking early for Shutdown. Service thread only.
+	 * @return False if shutting down.
+	 */
+	bool WaitFor(std::chrono::steady_clock::duration duration);
+
+public: // IThread
+	void RunThread(IThreadHandle *pHandle);
+	void OnTerminate(IThreadHandle *pHandle, bool cancel);
+
+private:
+	void ApplySchedulingPolicy();
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	std::deque<std::function<void()>> m_tasks;
+	std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> m_delayed;
+	bool m_shutdown = false;
+	IThreadHandle *m_thread = nullptr;
+};
+
+extern ServiceThread g_servicethread;
+
+#endif // !_INCLUDE_SERVICE_THREAD_H_
@@ -0,0 +1,211 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SymbolStore.h"
+#include "FileUtils.h"
+
+#include "common/linux/file_id.h"
+#include "common/memory_allocator.h"
+#include "google_breakpad/processor/code_module.h"
+
+SymbolStore g_symbolstore;
+
+static std::string FileName(const std::string &path)
+{
+	std::string::size_type slash = path.rfind('/');
+	return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+static std::string UpperCase(std::string value)
+{
+	for (auto &c : value) {
+		c = toupper((unsigned char)c);
+	}
+
+	return value;
+}
+
+static bool CreateDirectory(const std::string &path)
+{
+	return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+void SymbolStore::Init(const std::string &root)
+{
+	m_root = root;
+}
+
+std::string SymbolStore::GetPath(const std::string &debugFile, const std::string &debugId) const
+{
+	std::string name = FileName(debugFile);
+	return m_root + "/" + name + "/" + UpperCase(debugId) + "/" + name + ".sym";
+}
+
+bool SymbolStore::Contains(const std::string &debugFile, const std::string &debugId, SymbolData symbolData) const
+{
+	if (m_root.empty() || debugId.empty()) {
+		return false;
+	}
+
+	std::string path = GetPath(debugFile, debugId);
+
+	std::string level;
+	if (!ReadWholeFile(path + ".data", level) || atoi(level.c_str()) != symbolData) {
+		return false;
+	}
+
+	return access(path.c_str(), R_OK) == 0;
+}
+
+bool SymbolStore::Load(const std::string &debugFile, const std::string &debugId, SymbolData symbolData, std::string &symbols) const
+{
+	if (!Contains(debugFile, debugId, symbolData)) {
+		return false;
+	}
+
+	return ReadWholeFile(GetPath(debugFile, debugId), symbols) && !symbols.empty();
+}
+
+bool SymbolStore::Load(const std::string &debugFile, const std::string &debugId, std::string &symbols) const
+{
+	if (m_root.empty() || debugId.empty()) {
+		return false;
+	}
+
+	return ReadWholeFile(GetPath(debugFile, debugId), symbols) && !symbols.empty();
+}
+
+bool SymbolStore::Save(SymbolData symbolData, const std::string &symbols) const
+{
+	if (m_root.empty()) {
+		return false;
+	}
+
+	// MODULE <os> <arch> <id> <name>
+	std::string header = symbols.substr(0, symbols.find('\n'));
+	char os[32], arch[32], debugId[64], name[256];
+	if (sscanf(header.c_str(), "MODULE %31s %31s %63s %255[^\n]", os, arch, debugId, name) != 4) {
+		return false;
+	}
+
+	std::string moduleDir = m_root + "/" + FileName(name);
+	std::string idDir = moduleDir + "/" + UpperCase(debugId);
+	if (!CreateDirectory(moduleDir) || !CreateDirectory(idDir)) {
+		return false;
+	}
+
+	std::string path = GetPath(name, debugId);
+	return WriteFileAtomically(path + ".data", std::to_string(symbolData)) && WriteFileAtomically(path, symbols);
+}
+
+bool SymbolStore::GetDebugIdentifier(const std::string &path, std::string &debugId)
+{
+	google_breakpad::PageAllocator allocator;
+	google_breakpad::wasteful_vector<uint8_t> identifier(&allocator, google_breakpad::kDefaultBuildIdSize);
+
+	google_breakpad::FileID fileId(path.c_str());
+	if (!fileId.ElfFileIdentifier(identifier)) {
+		return false;
+	}
+
+	// Same format as the minidump writer and dump_symbols: GUID followed by a zero age.
+	debugId = google_breakpad::FileID::ConvertIdentifierToUUIDString(identifier) + "0";
+	return true;
+}
+
+// Keeps the records stack walking needs, drops line, file and inline records.
+static void FilterUnwindRecords(const std::string &symbols, std::string &filtered)
+{
+	static const char *kKeep[] = { "MODULE ", "INFO ", "FUNC ", "PUBLIC ", "STACK " };
+
+	filtered.reserve(symbols.size() / 4);
+
+	size_t lineStart = 0;
+	while (lineStart < symbols.size()) {
+		size_t lineEnd = symbols.find('\n', lineStart);
+		if (lineEnd == std::string::npos) {
+			lineEnd = symbols.size();
+		} else {
+			lineEnd++;
+		}
+
+		for (const char *prefix : kKeep) {
+			if (symbols.compare(lineStart, strlen(prefix), prefix) == 0) {
+				filtered.append(symbols, lineStart, lineEnd - lineStart);
+				break;
+			}
+		}
+
+		lineStart = lineEnd;
+	}
+}
+
+SymbolStoreSupplier::~SymbolStoreSupplier()
+{
+	for (auto &buffer : m_memorybuffers) {
+		delete[] buffer.second;
+	}
+}
+
+SymbolStoreSupplier::SymbolResult SymbolStoreSupplier::GetSymbolFile(const google_breakpad::CodeModule *module, const google_breakpad::SystemInfo *system_info, std::string *symbol_file)
+{
+	std::string symbol_data;
+	return GetSymbolFile(module, system_info, symbol_file, &symbol_data);
+}
+
+SymbolStoreSupplier::SymbolResult SymbolStoreSupplier::GetSymbolFile(const google_breakpad::CodeModule *module, const google_breakpad::SystemInfo *system_info, std::string *symbol_file, std::string *symbol_data)
+{
+	if (!module) {
+		return NOT_FOUND;
+	}
+
+	std::string symbols;
+	if (!m_store.Load(module->debug_file(), module->debug_identifier(), symbols)) {
+		return NOT_FOUND;
+	}
+
+	if (symbol_file) {
+		*symbol_file = module->debug_file();
+	}
+
+	symbol_data->clear();
+	FilterUnwindRecords(symbols, *symbol_data);
+	return FOUND;
+}
+
+SymbolStoreSupplier::SymbolResult SymbolStoreSupplier::GetCStringSymbolData(const google_breakpad::CodeModule *module, const google_breakpad::SystemInfo *system_info, std::string *symbol_file, char **symbol_data, size_t *symbol_data_size)
+{
+	std::string symbol_data_string;
+	SymbolResult result = GetSymbolFile(module, system_info, symbol_file, &symbol_data_string);
+	if (result != FOUND) {
+		*symbol_data = nullptr;
+		*symbol_data_size = 0;
+		return result;
+	}
+
+	// The resolver expects a null terminated buffer, counted in the size.
+	*symbol_data_size = symbol_data_string.size() + 1;
+	*symbol_data = new char[*symbol_data_size];
+	memcpy(*symbol_data, symbol_data_string.c_str(), *symbol_data_size);
+
+	FreeSymbolData(module);
+	m_memorybuffers[module->code_file()] = *symbol_data;
+	return FOUND;
+}
+
+void SymbolStoreSupplier::FreeSymbolData(const google_breakpad::CodeModule *module)
+{
+	if (!module) {
+		return;
+	}
+
+	auto buffer = m_memorybuffers.find(module->code_file());
+	if (buffer != m_memorybuffers.end()) {
+		delete[] buffer->second;
+		m_memorybuffers.erase(buffer);
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef _INCLUDE_SYMBOL_STORE_H_
+#define _INCLUDE_SYMBOL_STORE_H_
+
+#include <map>
+#include <string>
+#include "common/symbol_data.h"
+#include "google_breakpad/processor/symbol_supplier.h"
+
+/**
+ * @brief Local cache of generated Breakpad symbol files, keyed by module name and debug identifier.
+ *
+ * Files are laid out the way SimpleSymbolSupplier expects them (<root>/<name>/<id>/<name>.sym), with
+ * a <name>.sym.data sidecar recording the SymbolData level the file was generated with, so a change
+ * of MinidumpSymbolData* options regenerates the file instead of uploading the wrong level.
+ *
+ * Only the service thread touches the store.
+ */
+class SymbolStore
+{
+public:
+	/**
+	 * @brief Sets the store root. The directory must already exist.
+	 */
+	void Init(const std::string &root);
+	/**
+	 * @brief Checks whether symbols at the given level are stored for a module.
+	 * @param debugFile Module debug file, only the file name part is used.
+	 * @param debugId Breakpad debug identifier.
+	 */
+	bool Contains(const std::string &debugFile, const std::string &debugId, SymbolData symbolData) const;
+	/**
+	 * @brief Reads stored symbols for a module.
+	 * @return False if the module is not stored at the given level.
+	 */
+	bool Load(const std::string &debugFile, const std::string &debugId, SymbolData symbolData, std::string &symbols) const;
+	/**
+	 * @brief Reads stored symbols for a module, whatever level they were generated at.
+	 */
+	bool Load(const std::string &debugFile, const std::string &debugId, std::string &symbols) const;
+	/**
+	 * @brief Stores a symbol file, keyed by the name and identifier on its MODULE line.
+	 */
+	bool Save(SymbolData symbolData, const std::string &symbols) const;
+
+	/**
+	 * @brief Computes the debug identifier Breakpad assigns to an ELF file (build ID, or a hash of its text).
+	 */
+	static bool GetDebugIdentifier(const std::string &path, std::string &debugId);
+
+private:
+	std::string GetPath(const std::string &debugFile, const std::string &debugId) const;
+
+	std::string m_root;
+};
+
+extern SymbolStore g_symbolstore;
+
+/**
+ * @brief Supplies stored symbols to the minidump processor so the stack walker can unwind with CFI.
+ *
+ * Only the records the stack walker uses are handed over (FUNC, PUBLIC and STACK, not line, file or
+ * inline records), which keeps loading fast even for modules stored with full symbol data. Modules
+ * without stored symbols are reported as not found and walked with the usual heuristics.
+ */
+class SymbolStoreSupplier : public google_breakpad::SymbolSupplier
+{
+public:
+	explicit SymbolStoreSupplier(const SymbolStore &store) : m_store(store) {}
+	~SymbolStoreSupplier();
+
+public: // SymbolSupplier
+	SymbolResult GetSymbolFile(const google_breakpad::CodeModule *module, const google_breakpad::SystemInfo *system_info, std::string *symbol_file);
+	SymbolResult GetSymbolFile(const google_breakpad::CodeModule *module, const google_breakpad::SystemInfo *system_info, std::string *symbol_file, std::string *symbol_data);
+	SymbolResult GetCStringSymbolData(const google_breakpad::CodeModule *module, const google_breakpad::SystemInfo *system_info, std::string *symbol_file, char **symbol_data, size_t *symbol_data_size);
+	void FreeSymbolData(const google_breakpad::CodeModule *module);
+
+private:
+	const SymbolStore &m_store;
+	std::map<std::string, char *> m_memorybuffers; // Keyed by module code file.
+};
+
+#endif // !_INCLUDE_SYMBOL_STORE_H_
@@ -0,0 +1,306 @@
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "UploadLog.h"
+
+// How long queued records may sit before the writer picks them up.
+static const std::chrono::seconds kFlushInterval(1);
+
+UploadLog g_uploadlog;
+
+void UploadLog::Start(const char *path)
+{
+	m_path = path;
+
+	const char *formatOption = g_pSM->GetCoreConfigValue("MinidumpLogFormat");
+	m_json = formatOption && tolower(formatOption[0]) == 'j';
+
+	const char *maxSizeOption = g_pSM->GetCoreConfigValue("MinidumpLogMaxSize");
+	if (maxSizeOption) {
+		m_maxsize = strtoull(maxSizeOption, nullptr, 10);
+	}
+
+	const char *maxFilesOption = g_pSM->GetCoreConfigValue("MinidumpLogFiles");
+	if (maxFilesOption) {
+		m_maxfiles = atoi(maxFilesOption);
+	}
+
+	m_thread = threader->MakeThread(this, Thread_Default);
+}
+
+void UploadLog::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+
+	m_wakeup.notify_all();
+
+	if (m_thread) {
+		m_thread->WaitForThread();
+		m_thread->DestroyThis();
+		m_thread = nullptr;
+	}
+}
+
+void UploadLog::Flush()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_flushrequested = true;
+	}
+
+	m_wakeup.notify_one();
+}
+
+void UploadLog::Message(const char *dump, const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	MessageV(dump, format, ap);
+	va_end(ap);
+}
+
+void UploadLog::MessageV(const char *dump, const char *format, va_list ap)
+{
+	char buffer[1024];
+	vsnprintf(buffer, sizeof(buffer), format, ap);
+
+	Record *record = new Record();
+	record->time = std::chrono::system_clock::now();
+	record->stage = -1;
+	record->dump = dump ? dump : "";
+	record->microseconds = 0;
+	record->bytes = 0;
+	record->succeeded = true;
+	record->message = buffer;
+
+	Push(record);
+}
+
+void UploadLog::Stage(UploadStage stage, const char *dump, uint64_t microseconds, uint64_t bytes, bool succeeded)
+{
+	Record *record = new Record();
+	record->time = std::chrono::system_clock::now();
+	record->stage = stage;
+	record->dump = dump ? dump : "";
+	record->microseconds = microseconds;
+	record->bytes = bytes;
+	record->succeeded = succeeded;
+
+	Push(record);
+}
+
+void UploadLog::Push(Record *record)
+{
+	record->next = m_head.load(std::memory_order_relaxed);
+	while (!m_head.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed)) {
+	}
+}
+
+void UploadLog::RunThread(IThreadHandle *pHandle)
+{
+	for (;;) {
+		bool shutdown;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeup.wait_for(lock, kFlushInterval, [this] { return m_shutdown || m_flushrequested; });
+			m_flushrequested = false;
+			shutdown = m_shutdown;
+		}
+
+		WriteQueued();
+
+		if (shutdown) {
+			break;
+		}
+	}
+
+	if (m_file) {
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+void UploadLog::OnTerminate(IThreadHandle *pHandle, bool cancel)
+{
+}
+
+void UploadLog::WriteQueued()
+{
+	Record *head = m_head.exchange(nullptr, std::memory_order_acquire);
+	if (!head) {
+		return;
+	}
+
+	// The list is newest first.
+	Record *ordered = nullptr;
+	while (head) {
+		Record *next = head->next;
+		head->next = ordered;
+		ordered = head;
+		head = next;
+	}
+
+	std::string batch;
+	while (ordered) {
+		Record *next = ordered->next;
+		Format(ordered, batch);
+		delete ordered;
+		ordered = next;
+	}
+
+	if (m_file && m_maxsize > 0 && m_size > 0 && m_size + batch.size() > m_maxsize) {
+		Rotate();
+	}
+
+	if (!m_file) {
+		m_file = fopen(m_path.c_str(), "a");
+		if (!m_file) {
+			g_pSM->LogError(myself, "Failed to open Accelerator log file: %s", m_path.c_str());
+			return;
+		}
+
+		fseek(m_file, 0, SEEK_END);
+		long size = ftell(m_file);
+		m_size = (size > 0) ? size : 0;
+	}
+
+	fwrite(batch.data(), 1, batch.size(), m_file);
+	fflush(m_file);
+	m_size += batch.size();
+}
+
+void UploadLog::Rotate()
+{
+	fclose(m_file);
+	m_file = nullptr;
+
+	if (m_maxfiles <= 0) {
+		remove(m_path.c_str());
+		return;
+	}
+
+	char from[512], to[512];
+	for (int i = m_maxfiles - 1; i >= 1; --i) {
+		snprintf(from, sizeof(from), "%s.%d", m_path.c_str(), i);
+		snprintf(to, sizeof(to), "%s.%d", m_path.c_str(), i + 1);
+		remove(to);
+		rename(from, to);
+	}
+
+	snprintf(to, sizeof(to), "%s.1", m_path.c_str());
+	remove(to);
+	rename(m_path.c_str(), to);
+}
+
+static void AppendJsonString(std::string &output, const std::string &value)
+{
+	output += '"';
+
+	for (unsigned char c : value) {
+		switch (c) {
+			case '"':
+				output += "\\\"";
+				break;
+			case '\\':
+				output += "\\\\";
+				break;
+			case '\n':
+				output += "\\n";
+				break;
+			case '\r':
+				output += "\\r";
+				break;
+			case '\t':
+				output += "\\t";
+				break;
+			default:
+				if (c < 0x20) {
+					char escape[8];
+					snprintf(escape, sizeof(escape), "\\u%04x", c);
+					output += escape;
+				} else {
+					output += c;
+				}
+				break;
+		}
+	}
+
+	output += '"';
+}
+
+void UploadLog::Format(const Record *record, std::string &output) const
+{
+	time_t seconds = std::chrono::system_clock::to_time_t(record->time);
+	struct tm tm;
+	char buffer[256];
+
+	if (m_json) {
+#if defined _WINDOWS
+		gmtime_s(&tm, &seconds);
+#else
+		gmtime_r(&seconds, &tm);
+#endif
+
+		int milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(record->time.time_since_epoch()).count() % 1000;
+		size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+		snprintf(&buffer[length], sizeof(buffer) - length, ".%03dZ", milliseconds);
+
+		output += "{\"time\":\"";
+		output += buffer;
+		output += '"';
+
+		if (record->stage >= 0) {
+			output += ",\"stage\":";
+			AppendJsonString(output, UploadStageName[record->stage]);
+		}
+
+		if (!record->dump.empty()) {
+			output += ",\"dump\":";
+			AppendJsonString(output, record->dump);
+		}
+
+		if (record->stage >= 0) {
+			snprintf(buffer, sizeof(buffer), ",\"us\":%llu,\"bytes\":%llu,\"ok\":%s",
+				(unsigned long long)record->microseconds, (unsigned long long)record->bytes, record->succeeded ? "true" : "false");
+			output += buffer;
+		} else {
+			output += ",\"msg\":";
+			AppendJsonString(output, record->message);
+		}
+
+		output += "}\n";
+		return;
+	}
+
+#if defined _WINDOWS
+	localtime_s(&tm, &seconds);
+#else
+	localtime_r(&seconds, &tm);
+#endif
+
+	// Same prefix as SourceMod's own logs.
+	strftime(buffer, sizeof(buffer), "L %m/%d/%Y - %H:%M:%S: ", &tm);
+	output += buffer;
+
+	if (!record->dump.empty()) {
+		output += '[';
+		output += record->dump;
+		output += "] ";
+	}
+
+	if (record->stage >= 0) {
+		snprintf(buffer, sizeof(buffer), "%s %s in %.1f ms (%llu bytes)", UploadStageName[record->stage],
+			record->succeeded ? "completed" : "failed", record->microseconds / 1000.0, (unsigned long long)record->bytes);
+		output += buffer;
+	} else {
+		output += record->message;
+	}
+
+	output += '\n';
+}
@@ -0,0 +1,95 @@
+#ifndef _INCLUDE_UPLOAD_LOG_H_
+#define _INCLUDE_UPLOAD_LOG_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include "UploadStats.h"
+#include "smsdk_ext.h"
+
+/**
+ * @brief Buffered writer for accelerator.log.
+ *
+ * Producers push records onto a lock-free list and return without touching the file. A dedicated
+ * writer thread collects everything queued about once a second (or on Flush), formats it and hands
+ * it to the file in one write.
+ *
+ * core.cfg options:
+ *   MinidumpLogFormat   "text" (default) or "json" for one JSON object per line
+ *   MinidumpLogMaxSize  Rotate the log once it would grow past this many bytes, default 10485760, 0 to disable
+ *   MinidumpLogFiles    Number of rotated logs to keep (accelerator.log.1 and up), default 3
+ */
+class UploadLog : public IThread
+{
+public:
+	/**
+	 * @brief Reads the core.cfg options and starts the writer thread. Main thread only.
+	 */
+	void Start(const char *path);
+	/**
+	 * @brief Writes out everything queued and stops the writer thread. Main thread only.
+	 */
+	void Shutdown();
+	/**
+	 * @brief Asks the writer to write out what is queued now rather than at the next interval. (thread safe)
+	 */
+	void Flush();
+
+	/**
+	 * @brief Queues a free-form message. (thread safe)
+	 * @param dump Name of the crash dump being processed, or nullptr.
+	 */
+	void Message(const char *dump, const char *format, ...);
+	void MessageV(const char *dump, const char *format, va_list ap);
+	/**
+	 * @brief Queues a completed pipeline stage. (thread safe)
+	 * @param dump Name of the crash dump being processed, or nullptr.
+	 */
+	void Stage(UploadStage stage, const char *dump, uint64_t microseconds, uint64_t bytes, bool succeeded);
+
+public: // IThread
+	void RunThread(IThreadHandle *pHandle);
+	void OnTerminate(IThreadHandle *pHandle, bool cancel);
+
+private:
+	struct Record {
+		Record *next;
+		std::chrono::system_clock::time_point time;
+		int stage; // UploadStage, or -1 for a message.
+		std::string dump;
+		uint64_t microseconds;
+		uint64_t bytes;
+		bool succeeded;
+		std::string message;
+	};
+
+	void Push(Record *record);
+	void WriteQueued();
+	void Format(const Record *record, std::string &output) const;
+	void Rotate();
+
+	std::atomic<Record *> m_head{nullptr};
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	bool m_flushrequested = false;
+	bool m_shutdown = false;
+	IThreadHandle *m_thread = nullptr;
+
+	// Writer thread only.
+	std::string m_path;
+	FILE *m_file = nullptr;
+	uint64_t m_size = 0;
+	bool m_json = false;
+	uint64_t m_maxsize = 10 * 1024 * 1024;
+	int m_maxfiles = 3;
+};
+
+extern UploadLog g_uploadlog;
+
+#endif // !_INCLUDE_UPLOAD_LOG_H_
@@ -0,0 +1,112 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include "UploadScheduler.h"
+#include "ServiceThread.h"
+#include "smsdk_ext.h"
+
+// No frame for this long means the server is hibernating.
+static const std::chrono::seconds kHibernationThreshold(5);
+// Frames have to be this much slower than the healthy baseline to count as pressure.
+static const double kPressureFactor = 1.5;
+// Smoothing factor for the frame interval moving average.
+static const double kFrameIntervalAlpha = 0.05;
+
+UploadScheduler g_uploadscheduler;
+
+void UploadScheduler::Configure()
+{
+	const char *deferOption = g_pSM->GetCoreConfigValue("MinidumpDeferUploads");
+	m_enabled = deferOption && (tolower(deferOption[0]) == 'y' || deferOption[0] == '1');
+
+	const char *deadlineOption = g_pSM->GetCoreConfigValue("MinidumpDeferDeadline");
+	if (deadlineOption) {
+		m_deadline = std::chrono::seconds(atoi(deadlineOption));
+	}
+
+	const char *sizeOption = g_pSM->GetCoreConfigValue("MinidumpDeferSize");
+	if (sizeOption) {
+		m_heavyuploadsize = strtoull(sizeOption, nullptr, 10);
+	}
+}
+
+bool UploadScheduler::IsQuiet() const
+{
+	int64_t lastFrame = m_lastframe.load(std::memory_order_relaxed);
+	if (lastFrame == 0) {
+		// Still loading, nobody can be playing yet.
+		return true;
+	}
+
+	auto sinceLastFrame = std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lastFrame));
+	if (sinceLastFrame > kHibernationThreshold) {
+		return true;
+	}
+
+	return m_humanplayers.load(std::memory_order_relaxed) == 0 && !m_underpressure.load(std::memory_order_relaxed);
+}
+
+bool UploadScheduler::IsIdle() const
+{
+	return m_lastframe.load(std::memory_order_relaxed) != 0 && IsQuiet();
+}
+
+std::chrono::steady_clock::time_point UploadScheduler::GetLastFrameTime() const
+{
+	return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(m_lastframe.load(std::memory_order_relaxed)));
+}
+
+uint64_t UploadScheduler::WaitForQuietPeriod()
+{
+	if (!m_enabled || IsQuiet()) {
+		return 0;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if (!m_deferring) {
+		m_deferring = true;
+		m_deferstart = start;
+	}
+
+	while (!IsQuiet() && std::chrono::steady_clock::now() - m_deferstart < m_deadline) {
+		if (!g_servicethread.WaitFor(std::chrono::seconds(1))) {
+			break;
+		}
+	}
+
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void UploadScheduler::OnGameFrame(bool simulating)
+{
+	auto now = std::chrono::steady_clock::now();
+	int64_t lastFrame = m_lastframe.exchange(now.time_since_epoch().count(), std::memory_order_relaxed);
+
+	if (lastFrame != 0) {
+		double interval = std::chrono::duration<double>(now - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lastFrame))).count();
+		m_frameinterval = (m_framecount == 0) ? interval : (m_frameinterval + kFrameIntervalAlpha * (interval - m_frameinterval));
+
+		// Let the average settle before trusting it as a baseline.
+		if (++m_framecount > 100 && (m_baselineinterval == 0.0 || m_frameinterval < m_baselineinterval)) {
+			m_baselineinterval = m_frameinterval;
+		}
+
+		m_underpressure.store(m_baselineinterval > 0.0 && m_frameinterval > m_baselineinterval * kPressureFactor, std::memory_order_relaxed);
+	}
+
+	if (now - m_lastplayercount < std::chrono::seconds(1)) {
+		return;
+	}
+
+	m_lastplayercount = now;
+
+	int humanPlayers = 0;
+	int maxClients = playerhelpers->GetMaxClients();
+	for (int i = 1; i <= maxClients; ++i) {
+		IGamePlayer *player = playerhelpers->GetGamePlayer(i);
+		if (player && player->IsConnected() && !player->IsFakeClient()) {
+			humanPlayers++;
+		}
+	}
+
+	m_humanplayers.store(humanPlayers, std::memory_order_relaxed);
+}
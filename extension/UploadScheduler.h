@@ -0,0 +1,79 @@
+#ifndef _INCLUDE_UPLOAD_SCHEDULER_H_
+#define _INCLUDE_UPLOAD_SCHEDULER_H_
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+/**
+ * @brief Defers expensive upload work while the server is busy.
+ *
+ * The main thread feeds it from a game frame hook (human player count, frame interval), the upload
+ * thread asks it to wait before heavy stages. Waiting ends when the server is empty and ticking
+ * normally, when it stops ticking (hibernation), or when the deferral deadline passes.
+ *
+ * core.cfg options:
+ *   MinidumpDeferUploads   "yes" to enable, default "no"
+ *   MinidumpDeferDeadline  Maximum seconds to hold heavy work back, counted from the first deferral, default 600
+ *   MinidumpDeferSize      Crash uploads at least this many bytes count as heavy, default 1048576
+ */
+class UploadScheduler
+{
+public:
+	/**
+	 * @brief Reads the core.cfg options. Called from the upload thread before it starts.
+	 */
+	void Configure();
+	/**
+	 * @brief Blocks until heavy work may run, or the service thread is shut down. Service thread only.
+	 * @return Time spent waiting, in microseconds, 0 if the server was already quiet.
+	 */
+	uint64_t WaitForQuietPeriod();
+	/**
+	 * @brief Returns the crash upload size from which uploads are deferred.
+	 */
+	uint64_t GetHeavyUploadSize() const { return m_heavyuploadsize; }
+	/**
+	 * @brief Returns true once the server has started ticking and is currently quiet.
+	 *
+	 * Unlike WaitForQuietPeriod this ignores MinidumpDeferUploads, it is meant for optional work.
+	 */
+	bool IsIdle() const;
+	/**
+	 * @brief Returns when the last game frame ran, or a zero time point before the first. (thread safe)
+	 */
+	std::chrono::steady_clock::time_point GetLastFrameTime() const;
+	/**
+	 * @brief Returns the human player count seen by the game frame hook, refreshed once a second. (thread safe)
+	 */
+	int GetHumanPlayers() const { return m_humanplayers.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Game frame hook, main thread only.
+	 */
+	void OnGameFrame(bool simulating);
+
+private:
+	bool IsQuiet() const;
+
+	bool m_enabled = false;
+	std::chrono::seconds m_deadline{600};
+	uint64_t m_heavyuploadsize = 1024 * 1024;
+	bool m_deferring = false;
+	std::chrono::steady_clock::time_point m_deferstart;
+
+	// Written by the main thread.
+	std::atomic<int64_t> m_lastframe{0}; // steady_clock ticks of the last frame, 0 before the first.
+	std::atomic<int> m_humanplayers{0};
+	std::atomic<bool> m_underpressure{false};
+
+	// Main thread only.
+	double m_frameinterval = 0.0; // Smoothed frame interval in seconds.
+	double m_baselineinterval = 0.0; // Lowest smoothed interval seen, what a healthy tick looks like.
+	unsigned int m_framecount = 0;
+	std::chrono::steady_clock::time_point m_lastplayercount;
+};
+
+extern UploadScheduler g_uploadscheduler;
+
+#endif // !_INCLUDE_UPLOAD_SCHEDULER_H_
@@ -0,0 +1,57 @@
+#include "UploadStats.h"
+
+UploadStats g_uploadstats;
+
+const char *UploadStageName[kUSCount] = {
+	"Minidump processing",
+	"Presubmit",
+	"Symbol dump",
+	"Symbol upload",
+	"Binary upload",
+	"Crash upload",
+	"Upload throttling",
+	"Upload deferral",
+	"Symbol prewarm",
+	"Core dump conversion",
+	"Dump compression",
+};
+
+static void AtomicMax(std::atomic<uint64_t> &target, uint64_t value)
+{
+	uint64_t current = target.load(std::memory_order_relaxed);
+	while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+	}
+}
+
+uint64_t UploadStats::Record(UploadStage stage, std::chrono::steady_clock::time_point start, uint64_t bytes, bool succeeded)
+{
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	AtomicStageStats &stats = m_stages[stage];
+
+	stats.count.fetch_add(1, std::memory_order_relaxed);
+	if (!succeeded) {
+		stats.failures.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	stats.totalMicroseconds.fetch_add(elapsed, std::memory_order_relaxed);
+	AtomicMax(stats.maxMicroseconds, elapsed);
+
+	stats.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	AtomicMax(stats.maxBytes, bytes);
+
+	return elapsed;
+}
+
+UploadStats::StageStats UploadStats::Get(UploadStage stage) const
+{
+	const AtomicStageStats &stats = m_stages[stage];
+
+	StageStats snapshot;
+	snapshot.count = stats.count.load(std::memory_order_relaxed);
+	snapshot.failures = stats.failures.load(std::memory_order_relaxed);
+	snapshot.totalMicroseconds = stats.totalMicroseconds.load(std::memory_order_relaxed);
+	snapshot.maxMicroseconds = stats.maxMicroseconds.load(std::memory_order_relaxed);
+	snapshot.bytes = stats.bytes.load(std::memory_order_relaxed);
+	snapshot.maxBytes = stats.maxBytes.load(std::memory_order_relaxed);
+	return snapshot;
+}
@@ -0,0 +1,73 @@
+#ifndef _INCLUDE_UPLOAD_STATS_H_
+#define _INCLUDE_UPLOAD_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Keep in sync with AcceleratorStage in accelerator.inc
+enum UploadStage {
+	kUSMinidumpProcessing,
+	kUSPresubmit,
+	kUSSymbolDump,
+	kUSSymbolUpload,
+	kUSBinaryUpload,
+	kUSCrashUpload,
+	kUSThrottle,
+	kUSDeferred,
+	kUSSymbolPrewarm,
+	kUSCoreDumpConversion,
+	kUSDumpCompression,
+
+	kUSCount
+};
+
+extern const char *UploadStageName[kUSCount];
+
+/**
+ * @brief Timing and byte counters for each stage of the upload pipeline.
+ *
+ * Written by the upload thread, read from the main thread (console command and natives).
+ */
+class UploadStats
+{
+public:
+	struct StageStats {
+		uint64_t count;
+		uint64_t failures;
+		uint64_t totalMicroseconds;
+		uint64_t maxMicroseconds;
+		uint64_t bytes;
+		uint64_t maxBytes; // Largest single buffer / payload seen in this stage.
+	};
+
+	/**
+	 * @brief Records one completed operation.
+	 * @param stage Pipeline stage.
+	 * @param start Time the operation started.
+	 * @param bytes Size of the payload processed or sent.
+	 * @param succeeded False to count the operation as a failure.
+	 * @return Duration of the operation, in microseconds.
+	 */
+	uint64_t Record(UploadStage stage, std::chrono::steady_clock::time_point start, uint64_t bytes, bool succeeded);
+	/**
+	 * @brief Returns a snapshot of a stage's counters.
+	 */
+	StageStats Get(UploadStage stage) const;
+
+private:
+	struct AtomicStageStats {
+		std::atomic<uint64_t> count{0};
+		std::atomic<uint64_t> failures{0};
+		std::atomic<uint64_t> totalMicroseconds{0};
+		std::atomic<uint64_t> maxMicroseconds{0};
+		std::atomic<uint64_t> bytes{0};
+		std::atomic<uint64_t> maxBytes{0};
+	};
+
+	AtomicStageStats m_stages[kUSCount];
+};
+
+extern UploadStats g_uploadstats;
+
+#endif // !_INCLUDE_UPLOAD_STATS_H_
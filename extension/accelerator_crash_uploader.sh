@@ -0,0 +1,75 @@
+#!/bin/sh
+# Reference crash uploader, started by the extension right after a crash when core.cfg has
+#   "MinidumpCrashUploader"  "extensions/accelerator_crash_uploader.sh"
+# as
+#   accelerator_crash_uploader.sh <dump path> <metadata path> <MinidumpUrl>
+#
+# The extension leaves a <dump path>.uploading claim next to the dump, which keeps its own upload
+# thread away from it. Once the dump is sent, the response is left in a <dump path>.uploaded marker
+# and the dump is kept: no presubmit is done here, so the extension's next upload pass presubmits it
+# for its symbols and binaries, reports the crash ID to plugins and then deletes it. The claim is
+# removed either way, so a dump that couldn't be sent goes through the usual pipeline.
+#
+# Output goes to the accelerator log. Needs curl.
+
+dump="$1"
+metadata="$2"
+url="$3"
+
+log() {
+	echo "$(date -u '+%Y-%m-%dT%H:%M:%SZ') [crash uploader] $(basename "$dump"): $*"
+}
+
+trap 'rm -f "$dump.uploading"' EXIT
+
+if [ -z "$dump" ] || [ -z "$url" ]; then
+	log "Usage: $0 <dump path> <metadata path> <url>"
+	exit 2
+fi
+
+if [ ! -f "$dump" ]; then
+	log "Dump not found"
+	exit 1
+fi
+
+# data/dumps/<dump>, core.cfg and the server id are found from there.
+dumps="$(dirname "$dump")"
+coreConfig="$dumps/../../configs/core.cfg"
+
+set -- -F "upload_file_minidump=@$dump"
+
+if [ -n "$metadata" ] && [ -f "$metadata" ]; then
+	set -- "$@" -F "upload_file_metadata=@$metadata"
+
+	# The same fields the extension sends, from the CONFIG section it wrote.
+	for field in GameDirectory ExtensionVersion; do
+		value="$(sed -n "s/^$field=//p" "$metadata" | head -n 1)"
+		if [ -n "$value" ]; then
+			set -- "$@" -F "$field=$value"
+		fi
+	done
+fi
+
+if [ -f "$coreConfig" ]; then
+	account="$(sed -n 's/^[[:space:]]*"MinidumpAccount"[[:space:]]*"\([^"]*\)".*/\1/p' "$coreConfig" | tail -n 1)"
+	if [ -n "$account" ]; then
+		set -- "$@" -F "UserID=$account"
+	fi
+fi
+
+if [ -f "$dumps/server-id.txt" ]; then
+	set -- "$@" -F "ServerID=$(cat "$dumps/server-id.txt")"
+fi
+
+# Well inside the ten minutes the extension leaves a claim alone for.
+if ! response="$(curl --silent --show-error --fail --max-time 300 "$@" "$url" 2>&1)"; then
+	log "Failed to upload crash dump: $response"
+	exit 1
+fi
+
+log "Uploaded crash dump: $response"
+
+# Written before the claim goes, so the upload thread never sees the dump without either.
+printf '%s\n' "$response" > "$dump.uploaded.tmp" && mv -f "$dump.uploaded.tmp" "$dump.uploaded"
+
+exit 0
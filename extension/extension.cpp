@@ -24,9 +24,24 @@
 #endif
 
 #include <sp_vm_api.h>
+#include <amtl/am-string.h>
 
 #include <IWebternet.h>
 #include "MemoryDownloader.h"
+#include "ModuleClassifier.h"
+#include "CrashSignature.h"
+#include "PluginContexts.h"
+#include "UploadStats.h"
+#include "ServiceThread.h"
+#include "RateLimiter.h"
+#include "UploadScheduler.h"
+#include "UploadLog.h"
+#include "Breadcrumbs.h"
+#include "HangWatchdog.h"
+#include "MemoryMonitor.h"
+#include "DumpStorage.h"
+#include "CrashAnnotations.h"
+#include "ConsoleHistory.h"
 #include "forwards.h"
 #include "natives.h"
 
@@ -36,11 +51,22 @@
 #include "third_party/lss/linux_syscall_support.h"
 #include "common/linux/dump_symbols.h"
 #include "common/path_helper.h"
+#include "SymbolStore.h"
+#include "CoreDumpConverter.h"
+#include "HitchSampler.h"
+#include "RealtimeSignals.h"
+#include "Sandbox.h"
 
 #include <signal.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <paths.h>
+#include <link.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 class StderrInhibitor
 {
@@ -104,12 +130,20 @@ void operator delete[](void *ptr, size_t sz) {
 #include <google_breakpad/processor/minidump_processor.h>
 #include <google_breakpad/processor/process_state.h>
 #include <google_breakpad/processor/call_stack.h>
+#include <google_breakpad/processor/code_modules.h>
+#include <google_breakpad/processor/basic_source_line_resolver.h>
 #include <google_breakpad/processor/stack_frame.h>
+#include <processor/basic_code_module.h>
 #include <processor/pathname_stripper.h>
 
 #include <sstream>
+#include <fstream>
 #include <streambuf>
 #include <memory>
+#include <chrono>
+#include <sys/stat.h>
+#include <thread>
+#include <mutex>
 
 Accelerator g_accelerator;
 SMEXT_LINK(&g_accelerator);
@@ -135,10 +169,49 @@ char crashSourceModVersion[32];
 char steamInf[1024];
 
 char dumpStoragePath[512];
+char dumpMetadataPath[512];
 char logPath[512];
 
+// Set while the hang watchdog writes a dump, read by dumpCallback to tag the metadata.
+volatile unsigned int hangDumpSeconds = 0;
+// Set while the memory monitor writes a dump, read by dumpCallback to tag the metadata.
+volatile unsigned int memoryDumpMegabytes = 0;
+const char *volatile memoryDumpTrend = nullptr;
+// Set while a snapshot is written, read by dumpCallback to tag the metadata.
+char snapshotReason[256];
+// Keeps the hang watchdog and the memory monitor from writing at the same time and mixing up the tags.
+std::mutex liveDumpMutex;
+#if defined _LINUX
+pid_t mainThreadId = 0;
+#elif defined _WINDOWS
+DWORD mainThreadId = 0;
+#endif
+
 google_breakpad::ExceptionHandler *handler = NULL;
 
+// Registered as app memory with the crash handler, guarded so the hang watchdog can copy the registration.
+unsigned char *serializedPluginContexts = nullptr;
+uint32_t serializedPluginContextsSize = 0;
+std::mutex pluginContextsMutex;
+
+#if defined _LINUX
+// Registers the regions every dump carries on a handler other than the crash handler. Called off the
+// main thread, plugin contexts are left out rather than waited for if it is updating them.
+static void RegisterDumpAppMemory(google_breakpad::ExceptionHandler *dumpHandler)
+{
+	dumpHandler->RegisterAppMemory(g_breadcrumbs.GetBuffer(), g_breadcrumbs.GetBufferSize());
+
+	if (g_consolehistory.IsCapturing()) {
+		dumpHandler->RegisterAppMemory(g_consolehistory.GetBuffer(), g_consolehistory.GetBufferSize());
+	}
+
+	std::unique_lock<std::mutex> lock(pluginContextsMutex, std::try_to_lock);
+	if (lock.owns_lock() && serializedPluginContexts) {
+		dumpHandler->RegisterAppMemory(serializedPluginContexts, serializedPluginContextsSize);
+	}
+}
+#endif
+
 #if defined _LINUX
 void terminateHandler()
 {
@@ -169,27 +242,97 @@ const int kExceptionSignals[] = {
 
 const int kNumHandledSignals = sizeof(kExceptionSignals) / sizeof(kExceptionSignals[0]);
 
+// The hang dump being written, see WriteHangDump.
+char hangDumpPath[512];
+
+// Set from MinidumpCrashUploader, the executable dumpCallback starts to report a crash without waiting for a restart.
+char crashUploaderPath[512];
+char crashUploadUrl[512];
+int crashUploaderMaxFd = 1024;
+
+// Runs in the crashed process, raw syscalls only. The uploader is started detached as
+//   <MinidumpCrashUploader> <dump path> <metadata path> <MinidumpUrl>
+// with a <dump path>.uploading claim next to the dump, which keeps the upload thread away from the
+// dump while it is fresh (see DumpStorage). Once the dump is sent, the uploader should leave the
+// response in a <dump path>.uploaded marker and keep the dump, so the next upload pass still uploads
+// its symbols and binaries and reports the crash to plugins. It removes the claim either way, so
+// anything it couldn't send goes through the usual pipeline.
+// accelerator_crash_uploader.sh, shipped next to the extension, is a reference implementation.
+static void SpawnCrashUploader(const char *dumpPath)
+{
+	char claimPath[512];
+	my_strlcpy(claimPath, dumpPath, sizeof(claimPath));
+	my_strlcat(claimPath, ".uploading", sizeof(claimPath));
+
+	int claim = sys_open(claimPath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (claim == -1) {
+		return;
+	}
+
+	sys_close(claim);
+
+	pid_t child = sys_fork();
+	if (child == 0) {
+		// Fork again from a new session, so the uploader is reparented to init and survives whatever
+		// takes down the crashed server's process group.
+		sys_setsid();
+		if (sys_fork() != 0) {
+			sys__exit(0);
+		}
+
+		int devNull = sys_open("/dev/null", O_RDONLY, 0);
+		int log = sys_open(logPath, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+		sys_dup2(devNull, STDIN_FILENO);
+		sys_dup2(log, STDOUT_FILENO);
+		sys_dup2(log, STDERR_FILENO);
+
+		// The game's sockets would keep its ports bound for the restarted server.
+		for (int fd = STDERR_FILENO + 1; fd < crashUploaderMaxFd; ++fd) {
+			sys_close(fd);
+		}
+
+		kernel_sigset_t mask;
+		sys_sigemptyset(&mask);
+		sys_sigprocmask(SIG_SETMASK, &mask, NULL);
+
+		const char *argv[] = { crashUploaderPath, dumpPath, dumpMetadataPath, crashUploadUrl, NULL };
+		sys_execve(crashUploaderPath, argv, environ);
+		sys__exit(127);
+	}
+
+	if (child == -1) {
+		sys_unlink(claimPath);
+		return;
+	}
+
+	// Only the intermediate child, it exits as soon as the uploader is forked.
+	sys_waitpid(child, NULL, 0);
+}
+
 static bool dumpCallback(const google_breakpad::MinidumpDescriptor& descriptor, void* context, bool succeeded)
 {
 	//printf("Wrote minidump to: %s\n", descriptor.path());
 
+	// Only hang dumps are written to a descriptor, the watchdog thread opened it at hangDumpPath.
+	const char *dumpPath = descriptor.IsFD() ? hangDumpPath : descriptor.path();
+
 	if (succeeded) {
 		sys_write(STDOUT_FILENO, "Wrote minidump to: ", 19);
 	} else {
 		sys_write(STDOUT_FILENO, "Failed to write minidump to: ", 29);
 	}
 
-	sys_write(STDOUT_FILENO, descriptor.path(), my_strlen(descriptor.path()));
+	sys_write(STDOUT_FILENO, dumpPath, my_strlen(dumpPath));
 	sys_write(STDOUT_FILENO, "\n", 1);
 
 	if (!succeeded) {
 		return succeeded;
 	}
 
-	my_strlcpy(dumpStoragePath, descriptor.path(), sizeof(dumpStoragePath));
-	my_strlcat(dumpStoragePath, ".txt", sizeof(dumpStoragePath));
+	my_strlcpy(dumpMetadataPath, dumpPath, sizeof(dumpMetadataPath));
+	my_strlcat(dumpMetadataPath, ".txt", sizeof(dumpMetadataPath));
 
-	int extra = sys_open(dumpStoragePath, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+	int extra = sys_open(dumpMetadataPath, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
 	if (extra == -1) {
 		sys_write(STDOUT_FILENO, "Failed to open metadata file!\n", 30);
 		return succeeded;
@@ -215,10 +358,47 @@ static bool dumpCallback(const google_breakpad::MinidumpDescriptor& descriptor,
 	sys_write(extra, "\nExtensionBuild=", 16);
 	sys_write(extra, SM_BUILD_UNIQUEID, my_strlen(SM_BUILD_UNIQUEID));
 	sys_write(extra, steamInf, my_strlen(steamInf));
+	if (hangDumpSeconds) {
+		char number[32];
+		sys_write(extra, "\nHang=", 6);
+		my_uitos(number, hangDumpSeconds, my_uint_len(hangDumpSeconds));
+		sys_write(extra, number, my_uint_len(hangDumpSeconds));
+		sys_write(extra, "\nHangThread=", 12);
+		my_uitos(number, mainThreadId, my_uint_len(mainThreadId));
+		sys_write(extra, number, my_uint_len(mainThreadId));
+	}
+	if (memoryDumpMegabytes) {
+		char number[32];
+		sys_write(extra, "\nMemory=", 8);
+		my_uitos(number, memoryDumpMegabytes, my_uint_len(memoryDumpMegabytes));
+		sys_write(extra, number, my_uint_len(memoryDumpMegabytes));
+	}
+	if (snapshotReason[0]) {
+		sys_write(extra, "\nSnapshot=", 10);
+		sys_write(extra, snapshotReason, my_strlen(snapshotReason));
+	}
+	for (unsigned int i = 0; i < CrashAnnotations::kSlotCount; ++i) {
+		char key[CrashAnnotations::kKeySize];
+		char value[CrashAnnotations::kValueSize];
+		if (g_crashannotations.Read(i, key, value)) {
+			sys_write(extra, "\nAnnotation.", 12);
+			sys_write(extra, key, my_strlen(key));
+			sys_write(extra, "=", 1);
+			sys_write(extra, value, my_strlen(value));
+		}
+	}
 	sys_write(extra, "\n-------- CONFIG END --------\n", 30);
 
-	if (GetSpew) {
-		GetSpew(spewBuffer, sizeof(spewBuffer));
+	if (memoryDumpTrend) {
+		sys_write(extra, memoryDumpTrend, my_strlen(memoryDumpTrend));
+	}
+
+	if (g_consolehistory.IsCapturing() || GetSpew) {
+		if (g_consolehistory.IsCapturing()) {
+			g_consolehistory.Copy(spewBuffer, sizeof(spewBuffer));
+		} else {
+			GetSpew(spewBuffer, sizeof(spewBuffer));
+		}
 
 		if (my_strlen(spewBuffer) > 0) {
 			sys_write(extra, "-------- CONSOLE HISTORY BEGIN --------\n", 40);
@@ -229,11 +409,263 @@ static bool dumpCallback(const google_breakpad::MinidumpDescriptor& descriptor,
 
 	sys_close(extra);
 
+	bool isCrash = !hangDumpSeconds && !memoryDumpMegabytes && !snapshotReason[0];
+
+	// Breakpad raises the signal again once we return, the core it leaves must not be converted into a second report.
+	if (isCrash && g_coredumpconverter.GetMarkerPath()[0]) {
+		sys_unlink(g_coredumpconverter.GetMarkerPath());
+	}
+
+	// Dumps of a live server are uploaded by the server itself, only crashes need a head start.
+	if (crashUploaderPath[0] && isCrash) {
+		SpawnCrashUploader(dumpPath);
+	}
+
 	return succeeded;
 }
 
+pthread_t mainThread;
+bool hangDumpSignalClaimed = false;
+
+enum HangDumpState {
+	kHDSIdle,
+	kHDSRequested,
+	kHDSWriting,
+};
+
+std::atomic<int> hangDumpState{kHDSIdle};
+std::atomic<bool> hangDumpWritten{false};
+google_breakpad::ExceptionHandler *hangDumpHandler = nullptr;
+
+// How long the main thread may take to write a hang dump it picked up before the watchdog gives up on it.
+const std::chrono::seconds kHangDumpWriteTimeout(60);
+
+// Runs on the main thread, so it is the requesting thread in the dump and its stack is the one walked.
+static void HangDumpSignalHandler(int signal, siginfo_t *info, void *context)
+{
+	int expected = kHDSRequested;
+	if (hangDumpState.compare_exchange_strong(expected, kHDSWriting)) {
+		hangDumpWritten = hangDumpHandler->WriteMinidump();
+		hangDumpState.store(kHDSIdle);
+	}
+}
+
+// The hang dump handler is never installed, this also keeps it out of the way of real crashes.
+static bool HangDumpCrashFilter(void *context)
+{
+	return false;
+}
+
+// Called by the watchdog thread.
+static bool WriteHangDump(unsigned int stallSeconds)
+{
+	std::lock_guard<std::mutex> lock(liveDumpMutex);
+
+	// The main thread never finished the last one, its handler is still in use.
+	if (hangDumpState.load() != kHDSIdle) {
+		return false;
+	}
+
+	// WriteMinidump with a directory builds the next dump path in a std::string, which deadlocks the
+	// signal handler if the main thread hung holding the malloc lock. Writing to a descriptor opened
+	// here allocates nothing, so a separate handler is set up for it.
+	snprintf(hangDumpPath, sizeof(hangDumpPath), "%s/hang-%ld-%d.dmp", dumpStoragePath, (long)time(NULL), (int)getpid());
+	int hangDumpFd = open(hangDumpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (hangDumpFd == -1) {
+		return false;
+	}
+
+	hangDumpHandler = new google_breakpad::ExceptionHandler(google_breakpad::MinidumpDescriptor(hangDumpFd), HangDumpCrashFilter, dumpCallback, NULL, false, -1);
+	RegisterDumpAppMemory(hangDumpHandler);
+
+	hangDumpSeconds = stallSeconds;
+	hangDumpWritten = false;
+	hangDumpState.store(kHDSRequested);
+
+	if (pthread_kill(mainThread, HANG_DUMP_SIGNAL) == 0) {
+		for (int i = 0; i < 20 && hangDumpState.load() == kHDSRequested; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+
+	int expected = kHDSRequested;
+	if (hangDumpState.compare_exchange_strong(expected, kHDSIdle)) {
+		// The main thread didn't take the signal (blocked, or stuck in the kernel), dump from here.
+		// Every thread is still in the dump, HangThread in the metadata says which one is stalled.
+		hangDumpWritten = hangDumpHandler->WriteMinidump();
+	} else {
+		auto deadline = std::chrono::steady_clock::now() + kHangDumpWriteTimeout;
+		while (hangDumpState.load() != kHDSIdle && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+
+	hangDumpSeconds = 0;
+
+	if (hangDumpState.load() != kHDSIdle) {
+		// Still writing, the handler and descriptor are left to it and no more hang dumps are written.
+		return false;
+	}
+
+	delete hangDumpHandler;
+	hangDumpHandler = nullptr;
+	close(hangDumpFd);
+
+	if (!hangDumpWritten) {
+		unlink(hangDumpPath);
+	}
+
+	return hangDumpWritten;
+}
+
+// Seconds a snapshot child may take before it is killed, it may block on a lock held by a thread the fork left behind.
+const unsigned int kSnapshotTimeout = 120;
+pid_t snapshotChild = 0; // Main thread only.
+
+// Runs in the forked child, which holds a copy-on-write image of the process taken at the fork with only
+// the forking thread in it. Dumping it costs the game thread nothing beyond the fork itself.
+static void WriteSnapshotChild(const char *reason)
+{
+	for (int i = 0; i < kNumHandledSignals; ++i) {
+		signal(kExceptionSignals[i], SIG_DFL);
+	}
+
+	// Breakpad handles SIGTRAP as well, a trap in here must not be reported as a crash either.
+	signal(SIGTRAP, SIG_DFL);
+	signal(SIGALRM, SIG_DFL);
+	alarm(kSnapshotTimeout);
+
+	my_strlcpy(snapshotReason, reason, sizeof(snapshotReason));
+
+	if (!handler->WriteMinidump()) {
+		_exit(1);
+	}
+
+	// The child continues the parent's dump name sequence, give the snapshot a name the next crash can't take.
+	char number[32];
+	char path[512];
+	my_strlcpy(path, dumpStoragePath, sizeof(path));
+	my_strlcat(path, "/snapshot-", sizeof(path));
+	uintmax_t now = time(NULL);
+	my_uitos(number, now, my_uint_len(now));
+	number[my_uint_len(now)] = '\0';
+	my_strlcat(path, number, sizeof(path));
+	my_strlcat(path, "-", sizeof(path));
+	uintmax_t pid = sys_getpid();
+	my_uitos(number, pid, my_uint_len(pid));
+	number[my_uint_len(pid)] = '\0';
+	my_strlcat(path, number, sizeof(path));
+	my_strlcat(path, ".dmp", sizeof(path));
+
+	char dumpPath[512];
+	my_strlcpy(dumpPath, dumpMetadataPath, sizeof(dumpPath));
+	dumpPath[my_strlen(dumpPath) - 4] = '\0'; // .txt
+
+	rename(dumpPath, path);
+	my_strlcat(path, ".txt", sizeof(path));
+	rename(dumpMetadataPath, path);
+
+	_exit(0);
+}
+
+// Polled from the game frame, so the child is collected without a thread blocked on it. Called on the main thread.
+static void ReapSnapshotChild()
+{
+	if (snapshotChild == 0) {
+		return;
+	}
+
+	int status = 0;
+	pid_t waited = waitpid(snapshotChild, &status, WNOHANG);
+	if (waited == 0) {
+		return;
+	}
+
+	// Children are reaped by the kernel when SIGCHLD is ignored, their status is lost then.
+	if (waited == -1) {
+		g_uploadlog.Message(nullptr, "Snapshot process %d finished", snapshotChild);
+	} else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+		g_uploadlog.Message(nullptr, "Snapshot process %d wrote its snapshot", snapshotChild);
+	} else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+		g_uploadlog.Message(nullptr, "Snapshot process %d timed out", snapshotChild);
+	} else {
+		g_uploadlog.Message(nullptr, "Snapshot process %d failed to write a snapshot", snapshotChild);
+	}
+
+	snapshotChild = 0;
+}
+
+// Called on the main thread.
+static bool WriteSnapshotDump(const char *reason)
+{
+	// Frames stop while the server hibernates, so the last child may not have been polled yet.
+	ReapSnapshotChild();
+
+	if (snapshotChild != 0) {
+		return false;
+	}
+
+	pid_t child = fork();
+	if (child == 0) {
+		WriteSnapshotChild(reason);
+	}
+
+	if (child == -1) {
+		return false;
+	}
+
+	snapshotChild = child;
+	return true;
+}
+
+// Same config section dumpCallback writes, for crashes only a core file is left of.
+static std::string FormatCrashMetadata()
+{
+	std::string metadata = "-------- CONFIG BEGIN --------";
+	metadata += "\nMap=";
+	metadata += crashMap;
+	metadata += "\nGamePath=";
+	metadata += crashGamePath;
+	metadata += "\nCommandLine=";
+	metadata += crashCommandLine;
+	metadata += "\nSourceModPath=";
+	metadata += crashSourceModPath;
+	metadata += "\nGameDirectory=";
+	metadata += crashGameDirectory;
+	if (crashSourceModVersion[0]) {
+		metadata += "\nSourceModVersion=";
+		metadata += crashSourceModVersion;
+	}
+	metadata += "\nExtensionVersion=";
+	metadata += SM_VERSION;
+	metadata += "\nExtensionBuild=";
+	metadata += SM_BUILD_UNIQUEID;
+	metadata += steamInf;
+	metadata += "\n-------- CONFIG END --------\n";
+	return metadata;
+}
+
+// Written on the main thread at load, a server that crashes while the upload pass is still running
+// must already have one. Later updates are posted to the service thread.
+static void UpdateProcessSnapshot(bool immediately)
+{
+	if (!g_coredumpconverter.IsEnabled()) {
+		return;
+	}
+
+	std::string metadata = FormatCrashMetadata();
+	if (immediately) {
+		g_coredumpconverter.WriteProcessSnapshot(metadata);
+		return;
+	}
+
+	g_servicethread.Post([metadata]() { g_coredumpconverter.WriteProcessSnapshot(metadata); });
+}
+
 void OnGameFrame(bool simulating)
 {
+	ReapSnapshotChild();
+
 	std::set_terminate(terminateHandler);
 
 	bool weHaveBeenFuckedOver = false;
@@ -321,9 +753,9 @@ static bool dumpCallback(const wchar_t* dump_path,
 
 	printf("Wrote minidump to: %ls\\%ls.dmp\n", dump_path, minidump_id);
 
-	sprintf(dumpStoragePath, "%ls\\%ls.dmp.txt", dump_path, minidump_id);
+	sprintf(dumpMetadataPath, "%ls\\%ls.dmp.txt", dump_path, minidump_id);
 
-	FILE *extra = fopen(dumpStoragePath, "wb");
+	FILE *extra = fopen(dumpMetadataPath, "wb");
 	if (!extra) {
 		printf("Failed to open metadata file!\n");
 		return succeeded;
@@ -341,10 +773,33 @@ static bool dumpCallback(const wchar_t* dump_path,
 	fprintf(extra, "\nExtensionVersion=%s", SM_VERSION);
 	fprintf(extra, "\nExtensionBuild=%s", SM_BUILD_UNIQUEID);
 	fprintf(extra, "%s", steamInf);
+	if (hangDumpSeconds) {
+		fprintf(extra, "\nHang=%u", hangDumpSeconds);
+		fprintf(extra, "\nHangThread=%lu", (unsigned long)mainThreadId);
+	}
+	if (memoryDumpMegabytes) {
+		fprintf(extra, "\nMemory=%u", memoryDumpMegabytes);
+	}
+	if (snapshotReason[0]) {
+		fprintf(extra, "\nSnapshot=%s", snapshotReason);
+	}
+	for (unsigned int i = 0; i < CrashAnnotations::kSlotCount; ++i) {
+		char key[CrashAnnotations::kKeySize];
+		char value[CrashAnnotations::kValueSize];
+		if (g_crashannotations.Read(i, key, value)) {
+			fprintf(extra, "\nAnnotation.%s=%s", key, value);
+		}
+	}
 	fprintf(extra, "\n-------- CONFIG END --------\n");
 
-	if (GetSpew || GetSpewFastcall) {
-		if (GetSpew) {
+	if (memoryDumpTrend) {
+		fprintf(extra, "%s", memoryDumpTrend);
+	}
+
+	if (g_consolehistory.IsCapturing() || GetSpew || GetSpewFastcall) {
+		if (g_consolehistory.IsCapturing()) {
+			g_consolehistory.Copy(spewBuffer, sizeof(spewBuffer));
+		} else if (GetSpew) {
 			GetSpew(spewBuffer, sizeof(spewBuffer));
 		} else if (GetSpewFastcall) {
 			GetSpewFastcall(spewBuffer, sizeof(spewBuffer));
@@ -360,10 +815,59 @@ static bool dumpCallback(const wchar_t* dump_path,
 	return succeeded;
 }
 
+// Called by the watchdog thread. The dump blames the calling thread, HangThread in the metadata says
+// which one is stalled.
+static bool WriteHangDump(unsigned int stallSeconds)
+{
+	std::lock_guard<std::mutex> lock(liveDumpMutex);
+
+	hangDumpSeconds = stallSeconds;
+	bool written = handler->WriteMinidump();
+	hangDumpSeconds = 0;
+	return written;
+}
+
+// Called on the main thread. There is no fork here, the game thread waits while the handler thread writes the dump.
+static bool WriteSnapshotDump(const char *reason)
+{
+	std::unique_lock<std::mutex> lock(liveDumpMutex, std::try_to_lock);
+	if (!lock.owns_lock()) {
+		return false;
+	}
+
+	strncpy(snapshotReason, reason, sizeof(snapshotReason) - 1);
+	bool written = handler->WriteMinidump();
+	snapshotReason[0] = '\0';
+	return written;
+}
+
 #else
 #error Bad platform.
 #endif
 
+// Called by the memory monitor thread.
+static bool WriteMemoryDump(unsigned int residentMegabytes, const char *trend)
+{
+	std::lock_guard<std::mutex> lock(liveDumpMutex);
+
+	memoryDumpMegabytes = residentMegabytes;
+	memoryDumpTrend = trend;
+	bool written = handler->WriteMinidump();
+	memoryDumpTrend = nullptr;
+	memoryDumpMegabytes = 0;
+	return written;
+}
+
+static uint64_t GetFileSize(const char *path)
+{
+	struct stat st;
+	if (!path || !path[0] || stat(path, &st) != 0) {
+		return 0;
+	}
+
+	return st.st_size;
+}
+
 class ClogInhibitor
 {
 	std::streambuf *saved_clog = nullptr;
@@ -379,18 +883,160 @@ public:
 	}
 };
 
-class UploadThread: public IThread
+// Flat encoding for results coming back from the sandbox, both ends are the same binary.
+static void AppendInteger(std::string &buffer, uint64_t value)
+{
+	buffer.append((const char *)&value, sizeof(value));
+}
+
+static void AppendString(std::string &buffer, const std::string &value)
+{
+	AppendInteger(buffer, value.size());
+	buffer.append(value);
+}
+
+static bool ReadInteger(const std::string &buffer, size_t &position, uint64_t &value)
+{
+	if (buffer.size() - position < sizeof(value)) {
+		return false;
+	}
+
+	memcpy(&value, &buffer[position], sizeof(value));
+	position += sizeof(value);
+	return true;
+}
+
+static bool ReadString(const std::string &buffer, size_t &position, std::string &value)
+{
+	uint64_t size;
+	if (!ReadInteger(buffer, position, size) || buffer.size() - position < size) {
+		return false;
+	}
+
+	value.assign(buffer, position, size);
+	position += size;
+	return true;
+}
+
+// 0 = Disabled
+// 1 = System Only
+// 2 = System + Game
+// 3 = System + Game + Addons
+static bool ShouldSubmitModuleType(ModuleType moduleType, int symbolSubmitOption)
+{
+	switch (moduleType) {
+		case kMTSystem:
+			return symbolSubmitOption >= 1;
+		case kMTGame:
+			return symbolSubmitOption >= 2;
+		case kMTAddon:
+		case kMTExtension:
+			return symbolSubmitOption >= 3;
+		default:
+			return false;
+	}
+}
+
+static int GetSymbolSubmitOption()
+{
+	const char *symbolSubmitOptionStr = g_pSM->GetCoreConfigValue("MinidumpSymbolUpload");
+	return symbolSubmitOptionStr ? atoi(symbolSubmitOptionStr) : 3;
+}
+
+#if defined _LINUX
+static bool DumpSymbolFileInProcess(const std::string &debugFile, SymbolData symbolData, std::string &output)
 {
-	FILE *log = nullptr;
+	auto debugFileDir = google_breakpad::DirName(debugFile);
+	std::vector<std::string> debug_dirs{
+		debugFileDir,
+		debugFileDir + "/.debug",
+		"/usr/lib/debug" + debugFileDir,
+	};
+
+	std::ostringstream outputStream;
+	google_breakpad::DumpOptions options(symbolData, true, true, false);
+
+	StderrInhibitor stdrrInhibitor;
+
+	if (!WriteSymbolFile(debugFile, debugFile, "Linux", "", debug_dirs, options, outputStream)) {
+		outputStream.str("");
+		outputStream.clear();
+
+		// Try again without debug dirs.
+		if (!WriteSymbolFile(debugFile, debugFile, "Linux", "", {}, options, outputStream)) {
+			return false;
+		}
+	}
+
+	output = outputStream.str();
+	return true;
+}
+
+static bool DumpSymbolFile(const std::string &debugFile, SymbolData symbolData, std::string &output)
+{
+	return g_sandbox.Run("symbol dump", [&](std::string &symbols) {
+		return DumpSymbolFileInProcess(debugFile, symbolData, symbols);
+	}, output);
+}
+
+// full     = CFI + functions + lines + inlines
+// noinline = CFI + functions + lines
+// cfi      = CFI only (unwind info, no function names)
+static SymbolData GetSymbolDataForModule(ModuleType moduleType)
+{
+	const char *symbolDataOptionKey = nullptr;
+	switch (moduleType) {
+		case kMTSystem:
+			symbolDataOptionKey = "MinidumpSymbolDataSystem";
+			break;
+		case kMTGame:
+			symbolDataOptionKey = "MinidumpSymbolDataGame";
+			break;
+		case kMTAddon:
+			symbolDataOptionKey = "MinidumpSymbolDataAddon";
+			break;
+		case kMTExtension:
+			symbolDataOptionKey = "MinidumpSymbolDataExtension";
+			break;
+		default:
+			return ALL_SYMBOL_DATA;
+	}
+
+	const char *symbolDataOption = g_pSM->GetCoreConfigValue(symbolDataOptionKey);
+	if (!symbolDataOption || !symbolDataOption[0] || strcasecmp(symbolDataOption, "full") == 0) {
+		return ALL_SYMBOL_DATA;
+	}
+
+	if (strcasecmp(symbolDataOption, "noinline") == 0) {
+		return static_cast<SymbolData>(CFI | SYMBOLS_AND_FILES);
+	}
+
+	if (strcasecmp(symbolDataOption, "cfi") == 0) {
+		return CFI;
+	}
+
+	g_uploadlog.Message(nullptr, "Unknown %s value \"%s\", using full symbol data", symbolDataOptionKey, symbolDataOption);
+	return ALL_SYMBOL_DATA;
+}
+#endif
+
+class UploadThread
+{
+	std::string currentDump;
 	char serverId[38] = "";
+	RateLimiter rateLimiter;
 
-	void RunThread(IThreadHandle *pHandle) {
+public:
+	void Run() {
 		rootconsole->ConsolePrint("Accelerator upload thread started.");
 
-		log = fopen(logPath, "a");
-		if (!log) {
-			g_pSM->LogError(myself, "Failed to open Accelerator log file: %s", logPath);
-		}
+		// Bytes per second, 0 = unlimited. Burst defaults to one second worth, and bounds the size of a
+		// single upload, as nothing limits the rate within one request.
+		const char *uploadRateOption = g_pSM->GetCoreConfigValue("MinidumpUploadRate");
+		const char *uploadBurstOption = g_pSM->GetCoreConfigValue("MinidumpUploadBurst");
+		rateLimiter.Configure(uploadRateOption ? strtoull(uploadRateOption, nullptr, 10) : 0, uploadBurstOption ? strtoull(uploadBurstOption, nullptr, 10) : 0);
+
+		g_uploadscheduler.Configure();
 
 		char path[512];
 		g_pSM->Format(path, sizeof(path), "%s/server-id.txt", dumpStoragePath);
@@ -413,104 +1059,288 @@ class UploadThread: public IThread
 			}
 		}
 
-		IDirectory *dumps = libsys->OpenDirectory(dumpStoragePath);
+#if defined _LINUX
+		if (g_coredumpconverter.IsEnabled()) {
+			ConvertCoreDumps();
+		}
+#endif
 
-		int skip = 0;
-		int count = 0;
-		int failed = 0;
-		char metapath[512];
-		char presubmitToken[512];
-		char response[512];
+		g_dumpstorage.EnforceRetention();
 
-		while (dumps->MoreFiles()) {
-			if (!dumps->IsEntryFile()) {
-				dumps->NextEntry();
-				continue;
+		// A server restarted straight after a crash finds its dump only seconds old, wait for it rather than leave it.
+		time_t settle = g_dumpstorage.TimeUntilSettled();
+		if (settle > 0) {
+			Log("Waiting %d seconds for recently written dumps to settle", (int)settle);
+			if (!g_servicethread.WaitFor(std::chrono::seconds(settle))) {
+				return;
 			}
+		}
 
-			const char *name = dumps->GetEntryName();
+		std::vector<PendingDump> pending;
 
-			int namelen = strlen(name);
-			if (namelen < 4 || strcmp(&name[namelen-4], ".dmp") != 0) {
-				dumps->NextEntry();
-				continue;
+		for (const auto &stored : g_dumpstorage.List(true)) {
+			PendingDump dump;
+			dump.name = stored.name;
+			dump.path = stored.path;
+			dump.metapath = stored.metapath;
+			dump.uploadedpath = stored.uploadedpath;
+
+			if (!dump.uploadedpath.empty()) {
+				std::ifstream uploaded(dump.uploadedpath, std::ios::binary);
+				dump.crashresponse.assign((std::istreambuf_iterator<char>(uploaded)), std::istreambuf_iterator<char>());
+				while (!dump.crashresponse.empty() && (dump.crashresponse.back() == '\n' || dump.crashresponse.back() == '\r')) {
+					dump.crashresponse.pop_back();
+				}
 			}
 
-			g_pSM->Format(path, sizeof(path), "%s/%s", dumpStoragePath, name);
-			g_pSM->Format(metapath, sizeof(metapath), "%s.txt", path);
+			if (stored.compressed) {
+				// The pipeline works on an inflated copy, the compressed dump is kept until it is done with.
+				dump.name = stored.name.substr(0, stored.name.size() - 3);
+				dump.compressedpath = stored.path;
+				dump.path = DumpStorage::Decompress(stored);
 
-			if (!libsys->PathExists(metapath)) {
-				metapath[0] = '\0';
+				if (dump.path.empty()) {
+					g_uploadlog.Message(dump.name.c_str(), "Failed to decompress");
+					continue;
+				}
 			}
 
+			pending.push_back(std::move(dump));
+		}
+
+		const char *presubmitOption = g_pSM->GetCoreConfigValue("MinidumpPresubmit");
+		bool canPresubmit = !presubmitOption || (tolower(presubmitOption[0]) == 'y' || presubmitOption[0] == '1');
+
+		const char *batchPresubmitOption = g_pSM->GetCoreConfigValue("MinidumpPresubmitBatch");
+		bool batchPresubmit = batchPresubmitOption && (tolower(batchPresubmitOption[0]) == 'y' || batchPresubmitOption[0] == '1');
+
+		if (canPresubmit && batchPresubmit && pending.size() > 1) {
+			BatchPresubmitCrashDumps(pending);
+		}
+
+		int skip = 0;
+		int count = 0;
+		int failed = 0;
+		char presubmitToken[512];
+		char response[512];
+
+		for (auto &dump : pending) {
+			currentDump = dump.name;
+			bool keep = false;
+
 			presubmitToken[0] = '\0';
 			PresubmitResponse presubmitResponse = kPRUploadCrashDumpAndMetadata;
 
-			const char *presubmitOption = g_pSM->GetCoreConfigValue("MinidumpPresubmit");
-			bool canPresubmit = !presubmitOption || (tolower(presubmitOption[0]) == 'y' || presubmitOption[0] == '1');
-
 			if (canPresubmit) {
-				presubmitResponse = PresubmitCrashDump(path, presubmitToken, sizeof(presubmitToken));
+				presubmitResponse = PresubmitCrashDump(dump, presubmitToken, sizeof(presubmitToken));
+			}
+
+			// The module list is no longer needed once symbols and binaries have been queued.
+			dump.modules.clear();
+
+			// Already sent by the crash uploader, the presubmit was only for its symbols and binaries.
+			if (!dump.uploadedpath.empty()) {
+				presubmitResponse = kPRAlreadyUploaded;
 			}
 
 			switch (presubmitResponse) {
 				case kPRLocalError:
 					failed++;
 					g_pSM->LogError(myself, "Accelerator failed to locally process crash dump");
-					if (log) fprintf(log, "Failed to locally process crash dump");
+					Log("Failed to locally process crash dump");
 					break;
 				case kPRRemoteError:
 				case kPRUploadCrashDumpAndMetadata:
 				case kPRUploadMetadataOnly:
-					if (UploadCrashDump((presubmitResponse == kPRUploadMetadataOnly) ? nullptr : path, metapath, presubmitToken, response, sizeof(response))) {
+					AppendBreadcrumbs(dump);
+
+					if (UploadCrashDump((presubmitResponse == kPRUploadMetadataOnly) ? nullptr : dump.path.c_str(), dump.metapath.c_str(), presubmitToken, response, sizeof(response))) {
 						count++;
 						g_pSM->LogError(myself, "Accelerator uploaded crash dump: %s", response);
-						if (log) fprintf(log, "Uploaded crash dump: %s\n", response);
+						Log("Uploaded crash dump: %s", response);
 						UploadedCrash crash{ response };
 						g_accelerator.StoreUploadedCrash(crash);
 					} else {
 						failed++;
 						g_pSM->LogError(myself, "Accelerator failed to upload crash dump: %s", response);
-						if (log) fprintf(log, "Failed to upload crash dump: %s\n", response);
+						Log("Failed to upload crash dump: %s", response);
+						keep = true;
 					}
 					break;
+				case kPRAlreadyUploaded: {
+					count++;
+					g_pSM->LogError(myself, "Accelerator uploaded crash dump: %s", dump.crashresponse.c_str());
+					Log("Uploaded crash dump by the crash uploader: %s", dump.crashresponse.c_str());
+					UploadedCrash crash{ dump.crashresponse.c_str() };
+					g_accelerator.StoreUploadedCrash(crash);
+					break;
+				}
 				case kPRDontUpload:
 					skip++;
 					g_pSM->LogError(myself, "Accelerator crash dump upload skipped by server");
-					if (log) fprintf(log, "Skipped due to server request\n");
+					Log("Skipped due to server request");
 					break;
 			}
 
-			if (metapath[0]) {
-				unlink(metapath);
+			if (!dump.compressedpath.empty()) {
+				unlink(dump.path.c_str());
 			}
 
-			unlink(path);
-
-			if (log) fflush(log);
+			if (keep) {
+				// Left for the next upload pass, the retention policy bounds how long.
+				Log("Kept for the next upload pass");
+			} else {
+				if (!dump.metapath.empty()) {
+					unlink(dump.metapath.c_str());
+				}
 
-			dumps->NextEntry();
-		}
+				if (!dump.uploadedpath.empty()) {
+					unlink(dump.uploadedpath.c_str());
+				}
 
-		libsys->CloseDirectory(dumps);
+				unlink(dump.compressedpath.empty() ? dump.path.c_str() : dump.compressedpath.c_str());
+			}
 
-		if (log) {
-			fclose(log);
-			log = nullptr;
+			currentDump.clear();
 		}
 
+		g_uploadlog.Flush();
+
 		g_accelerator.MarkAsDoneUploading();
+		extforwards::CallOnDoneUploadingForward();
 		rootconsole->ConsolePrint("Accelerator upload thread finished. (%d skipped, %d uploaded, %d failed)", skip, count, failed);
+
+		// Every crash is reported by now, the symbols and binaries the presubmits asked for follow as tasks of their own.
+		for (auto &upload : moduleUploads) {
+			g_servicethread.Post([this, upload]() { UploadModule(upload); });
+		}
+
+		moduleUploads.clear();
+
+		// Whatever is still waiting, failed uploads and dumps written since the pass started, stays until a later one.
+		uint64_t compressedBytes = 0;
+		auto compressStart = std::chrono::steady_clock::now();
+		if (g_dumpstorage.CompressWaiting(compressedBytes) > 0) {
+			RecordStage(kUSDumpCompression, compressStart, compressedBytes, true);
+		}
+
+		g_dumpstorage.EnforceRetention();
+		g_uploadlog.Flush();
+	}
+
+private:
+	void Log(const char *format, ...) {
+		va_list ap;
+		va_start(ap, format);
+		g_uploadlog.MessageV(currentDump.empty() ? nullptr : currentDump.c_str(), format, ap);
+		va_end(ap);
+	}
+
+	void RecordStage(UploadStage stage, std::chrono::steady_clock::time_point start, uint64_t bytes, bool succeeded) {
+		uint64_t elapsed = g_uploadstats.Record(stage, start, bytes, succeeded);
+		g_uploadlog.Stage(stage, currentDump.empty() ? nullptr : currentDump.c_str(), elapsed, bytes, succeeded);
+	}
+
+	// Breadcrumbs travel in the minidump's app memory, copy the ones decoded with the rest of the
+	// analysis into the metadata for the collector.
+	void AppendBreadcrumbs(PendingDump &dump) {
+		static const char kBreadcrumbsBegin[] = "-------- BREADCRUMBS BEGIN --------\n";
+
+		// A dump kept from a failed upload already had them appended.
+		if (!dump.metapath.empty()) {
+			std::ifstream existing(dump.metapath, std::ios::binary);
+			std::string contents((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+			if (contents.find(kBreadcrumbsBegin) != std::string::npos) {
+				return;
+			}
+		}
+
+		// Presubmit has processed the dump already, unless it is turned off. Without it only the
+		// breadcrumbs are wanted, which don't need a stack walk.
+		if (!dump.processed) {
+#if defined _LINUX
+			bool decoded = g_sandbox.Run("breadcrumb decoding", [&](std::string &output) {
+				return Breadcrumbs::Decode(dump.path.c_str(), output);
+			}, dump.breadcrumbs);
+#else
+			bool decoded = Breadcrumbs::Decode(dump.path.c_str(), dump.breadcrumbs);
+#endif
+
+			if (!decoded) {
+				dump.breadcrumbs.clear();
+				return;
+			}
+		}
+
+		if (dump.breadcrumbs.empty()) {
+			return;
+		}
+
+		std::string metapath = dump.metapath.empty() ? dump.path + ".txt" : dump.metapath;
+		FILE *metadata = fopen(metapath.c_str(), "ab");
+		if (!metadata) {
+			Log("Failed to append breadcrumbs to %s", metapath.c_str());
+			return;
+		}
+
+		fputs(kBreadcrumbsBegin, metadata);
+		fwrite(dump.breadcrumbs.data(), 1, dump.breadcrumbs.size(), metadata);
+		fputs("-------- BREADCRUMBS END --------\n", metadata);
+		fclose(metadata);
+
+		dump.metapath = metapath;
+	}
+
+	bool ThrottleUpload(uint64_t bytes) {
+		if (!rateLimiter.Allows(bytes)) {
+			Log("Not uploading %llu bytes, more than MinidumpUploadBurst", (unsigned long long)bytes);
+			return false;
+		}
+
+		auto throttleStart = std::chrono::steady_clock::now();
+		if (rateLimiter.Acquire(bytes) > 0) {
+			RecordStage(kUSThrottle, throttleStart, bytes, true);
+		}
+
+		return true;
 	}
 
-	void OnTerminate(IThreadHandle *pHandle, bool cancel) {
-		rootconsole->ConsolePrint("Accelerator upload thread terminated. (canceled = %s)", (cancel ? "true" : "false"));
+	// Symbol dumping, binary uploads and large minidumps wait here while players are on.
+	void DeferHeavyWork(uint64_t bytes) {
+		auto deferStart = std::chrono::steady_clock::now();
+		if (g_uploadscheduler.WaitForQuietPeriod() > 0) {
+			RecordStage(kUSDeferred, deferStart, bytes, true);
+		}
 	}
 
 #if defined _LINUX
-	bool UploadSymbolFile(const google_breakpad::CodeModule *module, const char *presubmitToken) {
-		if (log) fprintf(log, "UploadSymbolFile\n");
-		if (log) fflush(log);
+	// Runs before the dumps directory is listed so converted cores go through the normal pipeline.
+	void ConvertCoreDumps() {
+		for (const auto &coreDump : g_coredumpconverter.FindCoreDumps()) {
+			char minidumpName[64];
+			g_pSM->Format(minidumpName, sizeof(minidumpName), "core-%d-%u.dmp", (int)coreDump.pid, (unsigned int)time(nullptr));
+			currentDump = minidumpName;
+
+			DeferHeavyWork(coreDump.size);
+
+			Log("Converting core dump %s", coreDump.path.c_str());
+			auto convertStart = std::chrono::steady_clock::now();
+			bool converted = g_coredumpconverter.Convert(coreDump, std::string(dumpStoragePath) + "/" + minidumpName);
+			RecordStage(kUSCoreDumpConversion, convertStart, coreDump.size, converted);
+
+			if (!converted) {
+				g_pSM->LogError(myself, "Accelerator failed to convert core dump %s", coreDump.path.c_str());
+				Log("Failed to convert core dump");
+			}
+
+			currentDump.clear();
+		}
+
+		g_coredumpconverter.RemoveStaleSnapshots();
+	}
+
+	bool UploadSymbolFile(const google_breakpad::CodeModule *module, const char *presubmitToken, SymbolData symbolData) {
+		Log("UploadSymbolFile");
 
 		auto debugFile = module->debug_file();
 		std::string vdsoOutputPath = "";
@@ -559,39 +1389,32 @@ class UploadThread: public IThread
 			return false;
 		}
 
-		if (log) fprintf(log, "Submitting symbols for %s\n", debugFile.c_str());
-		if (log) fflush(log);
+		std::string output;
 
-		auto debugFileDir = google_breakpad::DirName(debugFile);
-		std::vector<std::string> debug_dirs{
-			debugFileDir,
-			debugFileDir + "/.debug",
-			"/usr/lib/debug" + debugFileDir,
-		};
+		if (g_symbolstore.Load(module->debug_file(), module->debug_identifier(), symbolData, output)) {
+			Log("Submitting stored symbols for %s", debugFile.c_str());
+		} else {
+			DeferHeavyWork(0);
 
-		std::ostringstream outputStream;
-		google_breakpad::DumpOptions options(ALL_SYMBOL_DATA, true, true, false);
+			Log("Submitting symbols for %s", debugFile.c_str());
 
-		{
-			StderrInhibitor stdrrInhibitor;
+			auto symbolDumpStart = std::chrono::steady_clock::now();
+
+			if (!DumpSymbolFile(debugFile, symbolData, output)) {
+				Log("Failed to process symbol file");
+				RecordStage(kUSSymbolDump, symbolDumpStart, 0, false);
+				return false;
+			}
 
-			if (!WriteSymbolFile(debugFile, debugFile, "Linux", "", debug_dirs, options, outputStream)) {
-				outputStream.str("");
-				outputStream.clear();
+			RecordStage(kUSSymbolDump, symbolDumpStart, output.size(), true);
+			// output = output.substr(0, output.find("\n"));
+			// printf(">>> %s\n", output.c_str());
 
-				// Try again without debug dirs.
-				if (!WriteSymbolFile(debugFile, debugFile, "Linux", "", {}, options, outputStream)) {
-					if (log) fprintf(log, "Failed to process symbol file\n");
-					if (log) fflush(log);
-					return false;
-				}
+			if (debugFile != vdsoOutputPath) {
+				g_symbolstore.Save(symbolData, output);
 			}
 		}
 
-		auto output = outputStream.str();
-		// output = output.substr(0, output.find("\n"));
-		// printf(">>> %s\n", output.c_str());
-
 		if (debugFile == vdsoOutputPath) {
 			unlink(vdsoOutputPath.c_str());
 		}
@@ -617,11 +1440,16 @@ class UploadThread: public IThread
 		const char *symbolUrl = g_pSM->GetCoreConfigValue("MinidumpSymbolUrl");
 		if (!symbolUrl) symbolUrl = "http://crash.limetech.org/symbols/submit";
 
+		if (!ThrottleUpload(output.size())) {
+			return false;
+		}
+
+		auto symbolUploadStart = std::chrono::steady_clock::now();
 		bool symbolUploaded = xfer->PostAndDownload(symbolUrl, form, &data, NULL);
+		RecordStage(kUSSymbolUpload, symbolUploadStart, output.size(), symbolUploaded);
 
 		if (!symbolUploaded) {
-			if (log) fprintf(log, "Symbol upload failed: %s (%d)\n", xfer->LastErrorMessage(), xfer->LastErrorCode());
-			if (log) fflush(log);
+			Log("Symbol upload failed: %s (%d)", xfer->LastErrorMessage(), xfer->LastErrorCode());
 			return false;
 		}
 
@@ -632,9 +1460,8 @@ class UploadThread: public IThread
 		while (responseSize > 0 && response[responseSize - 1] == '\n') {
 			response[--responseSize] = '\0';
 		}
-		if (log) fprintf(log, "Symbol upload complete: %s\n", response);
+		Log("Symbol upload complete: %s", response);
 		delete[] response;
-		if (log) fflush(log);
 		return true;
 	}
 #endif
@@ -650,8 +1477,9 @@ class UploadThread: public IThread
 			return false;
 		}
 
-		if (log) fprintf(log, "Submitting binary for %s\n", codeFile.c_str());
-		if (log) fflush(log);
+		DeferHeavyWork(GetFileSize(codeFile.c_str()));
+
+		Log("Submitting binary for %s", codeFile.c_str());
 
 		IWebForm *form = webternet->CreateForm();
 
@@ -677,118 +1505,35 @@ class UploadThread: public IThread
 		const char *binaryUrl = g_pSM->GetCoreConfigValue("MinidumpBinaryUrl");
 		if (!binaryUrl) binaryUrl = "http://crash.limetech.org/binary/submit";
 
-		bool binaryUploaded = xfer->PostAndDownload(binaryUrl, form, &data, NULL);
-
-		if (!binaryUploaded) {
-			if (log) fprintf(log, "Binary upload failed: %s (%d)\n", xfer->LastErrorMessage(), xfer->LastErrorCode());
-			if (log) fflush(log);
+		uint64_t binarySize = GetFileSize(codeFile.c_str());
+		if (!ThrottleUpload(binarySize)) {
 			return false;
 		}
 
-		int responseSize = data.GetSize();
-		char *response = new char[responseSize + 1];
-		strncpy(response, data.GetBuffer(), responseSize + 1);
-		response[responseSize] = '\0';
-		while (responseSize > 0 && response[responseSize - 1] == '\n') {
-			response[--responseSize] = '\0';
-		}
-		if (log) fprintf(log, "Binary upload complete: %s\n", response);
-		if (log) fflush(log);
-		delete[] response;
-
-		return true;
-	}
-
-	enum ModuleType {
-		kMTUnknown,
-		kMTSystem,
-		kMTGame,
-		kMTAddon,
-		kMTExtension,
-	};
-
-	const char *ModuleTypeCode[5] = {
-		"Unknown",
-		"System",
-		"Game",
-		"Addon",
-		"Extension",
-	};
-
-#ifndef WIN32
-#define PATH_SEP "/"
-#else
-#define PATH_SEP "\\"
-#endif
-
-	bool PathPrefixMatches(const std::string &prefix, const std::string &path) {
-#ifndef WIN32
-		return strncmp(prefix.c_str(), path.c_str(), prefix.length()) == 0;
-#else
-		return _strnicmp(prefix.c_str(), path.c_str(), prefix.length()) == 0;
-#endif
-	}
-
-	struct PathComparator {
-		struct compare {
-			bool operator() (const unsigned char &a, const unsigned char &b) const {
-#ifndef WIN32
-				return a < b;
-#else
-				return tolower(a) < tolower(b);
-#endif
-			}
-		};
-
-		bool operator() (const std::string &a, const std::string &b) const {
-			return !std::lexicographical_compare(
-				a.begin(), a.end(),
-				b.begin(), b.end(),
-				compare());
-		};
-	};
-
-	std::map<std::string, ModuleType, PathComparator> modulePathMap;
-	bool InitModuleClassificationMap(const std::string &base) {
-		if (!modulePathMap.empty()) {
-			modulePathMap.clear();
-		}
-
-		modulePathMap[base] = kMTGame;
-		modulePathMap[std::string(crashGamePath) + PATH_SEP "addons" PATH_SEP] = kMTAddon;
-		modulePathMap[std::string(crashSourceModPath) + PATH_SEP "extensions" PATH_SEP] = kMTExtension;
-
-		return true;
-	}
-
-	ModuleType ClassifyModule(const google_breakpad::CodeModule *module) {
-		if (modulePathMap.empty()) {
-			return kMTUnknown;
-		}
-
-		const auto &codeFile = module->code_file();
-
-#ifndef WIN32
-		if (codeFile == "linux-gate.so") {
-			return kMTSystem;
-		}
+		auto binaryUploadStart = std::chrono::steady_clock::now();
+		bool binaryUploaded = xfer->PostAndDownload(binaryUrl, form, &data, NULL);
+		RecordStage(kUSBinaryUpload, binaryUploadStart, binarySize, binaryUploaded);
 
-		if (codeFile[0] != '/') {
-#else
-		if (codeFile[1] != ':') {
-#endif
-			return kMTUnknown;
+		if (!binaryUploaded) {
+			Log("Binary upload failed: %s (%d)", xfer->LastErrorMessage(), xfer->LastErrorCode());
+			return false;
 		}
 
-		for (decltype(modulePathMap)::const_iterator i = modulePathMap.begin(); i != modulePathMap.end(); ++i) {
-			if (PathPrefixMatches(i->first, codeFile)) {
-				return i->second;
-			}
+		int responseSize = data.GetSize();
+		char *response = new char[responseSize + 1];
+		strncpy(response, data.GetBuffer(), responseSize + 1);
+		response[responseSize] = '\0';
+		while (responseSize > 0 && response[responseSize - 1] == '\n') {
+			response[--responseSize] = '\0';
 		}
+		Log("Binary upload complete: %s", response);
+		delete[] response;
 
-		return kMTSystem;
+		return true;
 	}
 
+	ModuleClassifier moduleClassifier;
+
 	std::string PathnameStripper_Directory(const std::string &path) {
 		std::string::size_type slash = path.rfind('/');
 		std::string::size_type backslash = path.rfind('\\');
@@ -809,79 +1554,196 @@ class UploadThread: public IThread
 		kPRDontUpload,
 		kPRUploadCrashDumpAndMetadata,
 		kPRUploadMetadataOnly,
+		kPRAlreadyUploaded, // Not from the server, the crash uploader sent the dump.
 	};
 
-	PresubmitResponse PresubmitCrashDump(const char *path, char *tokenBuffer, size_t tokenBufferLength) {
-		google_breakpad::ProcessState processState;
-		google_breakpad::ProcessResult processResult;
-		google_breakpad::MinidumpProcessor minidumpProcessor(nullptr, nullptr);
+	// A symbol or binary upload asked for by a presubmit.
+	struct ModuleUpload {
+		std::string dump;
+		std::string presubmitToken;
+		std::shared_ptr<google_breakpad::BasicCodeModule> module;
+		ModuleType moduleType;
+		bool binary;
+		bool symbols;
+	};
 
-		{
-			ClogInhibitor clogInhibitor;
-			processResult = minidumpProcessor.Process(path, &processState);
+	std::vector<ModuleUpload> moduleUploads;
+
+	// Runs as its own service task, after the upload pass.
+	void UploadModule(const ModuleUpload &upload) {
+		currentDump = upload.dump;
+
+		if (upload.binary) {
+			UploadModuleFile(upload.module.get(), upload.presubmitToken.c_str());
 		}
 
-		if (processResult != google_breakpad::PROCESS_OK) {
-			return kPRLocalError;
+#if defined _LINUX
+		if (upload.symbols) {
+			UploadSymbolFile(upload.module.get(), upload.presubmitToken.c_str(), GetSymbolDataForModule(upload.moduleType));
 		}
+#endif
 
-		std::string os_short = "";
-		std::string cpu_arch = "";
-		if (processState.system_info()) {
-			os_short = processState.system_info()->os_short;
-			if (os_short.empty()) {
-				os_short = processState.system_info()->os;
-			}
-			cpu_arch = processState.system_info()->cpu;
+		currentDump.clear();
+		g_uploadlog.Flush();
+	}
+
+	struct PendingDump {
+		std::string name;
+		std::string path;
+		std::string metapath;
+		std::string compressedpath; // Set if path is an inflated copy of a compressed dump.
+		std::string uploadedpath; // Set if the crash uploader already sent the dump.
+		std::string crashresponse; // The crash uploader's response.
+
+		// Filled in by ProcessCrashDump.
+		bool processed = false;
+		bool processingFailed = false; // Set by BatchPresubmitCrashDumps, so it isn't tried again.
+		std::string signature;
+		std::vector<std::unique_ptr<google_breakpad::BasicCodeModule>> modules;
+		unsigned int mainModule = 0;
+		std::string breadcrumbs; // Empty if the dump has none.
+
+		// Filled in by BatchPresubmitCrashDumps.
+		bool batched = false;
+		std::string presubmitResponse;
+	};
+
+	bool ProcessCrashDump(PendingDump &dump) {
+		const char *stackwalkSymbolsOption = g_pSM->GetCoreConfigValue("MinidumpStackwalkSymbols");
+		bool stackwalkSymbols = !stackwalkSymbolsOption || tolower(stackwalkSymbolsOption[0]) == 'y' || stackwalkSymbolsOption[0] == '1';
+
+		// 2 = pipe-delimited text (default), 3 = compact binary, see CrashSignature.h
+		const char *signatureVersionOption = g_pSM->GetCoreConfigValue("MinidumpSignatureVersion");
+		bool compactSignature = signatureVersionOption && atoi(signatureVersionOption) == 3;
+
+		auto processStart = std::chrono::steady_clock::now();
+
+		std::string analysis;
+#if defined _LINUX
+		bool analyzed = g_sandbox.Run("minidump processing", [&](std::string &output) {
+			return AnalyzeCrashDump(dump.path, stackwalkSymbols, compactSignature, output);
+		}, analysis);
+#else
+		bool analyzed = AnalyzeCrashDump(dump.path, stackwalkSymbols, compactSignature, analysis);
+#endif
+
+		RecordStage(kUSMinidumpProcessing, processStart, GetFileSize(dump.path.c_str()), analyzed);
+
+		if (!analyzed) {
+			return false;
 		}
 
-		int requestingThread = processState.requesting_thread();
-		if (requestingThread == -1) {
-			requestingThread = 0;
+		size_t position = 0;
+		uint64_t moduleCount, mainModule;
+		if (!ReadString(analysis, position, dump.signature) || !ReadInteger(analysis, position, moduleCount) || !ReadInteger(analysis, position, mainModule)) {
+			return false;
 		}
 
-		const google_breakpad::CallStack *stack = processState.threads()->at(requestingThread);
-		if (!stack) {
-			return kPRLocalError;
+		// printf("%s\n", dump.signature.c_str());
+
+		dump.modules.clear();
+		dump.mainModule = mainModule;
+
+		for (uint64_t i = 0; i < moduleCount; ++i) {
+			uint64_t base, size;
+			std::string codeFile, codeIdentifier, debugFile, debugIdentifier, version;
+			if (!ReadInteger(analysis, position, base) || !ReadInteger(analysis, position, size) ||
+				!ReadString(analysis, position, codeFile) || !ReadString(analysis, position, codeIdentifier) ||
+				!ReadString(analysis, position, debugFile) || !ReadString(analysis, position, debugIdentifier) ||
+				!ReadString(analysis, position, version)) {
+				dump.modules.clear();
+				return false;
+			}
+
+			dump.modules.emplace_back(new google_breakpad::BasicCodeModule(base, size, codeFile, codeIdentifier, debugFile, debugIdentifier, version));
+		}
+
+		if (!ReadString(analysis, position, dump.breadcrumbs)) {
+			dump.modules.clear();
+			return false;
 		}
 
-		int frameCount = stack->frames()->size();
-		if (frameCount > 1024) {
-			frameCount = 1024;
+		if (!dump.modules.empty() && dump.mainModule >= dump.modules.size()) {
+			dump.mainModule = 0;
 		}
 
-		std::ostringstream summaryStream;
-		summaryStream << 2 << "|" << processState.time_date_stamp() << "|" << os_short << "|" << cpu_arch << "|" << processState.crashed() << "|" << processState.crash_reason() << "|" << std::hex << processState.crash_address() << std::dec << "|" << requestingThread;
+		dump.processed = true;
+		return true;
+	}
+
+	// Runs in the sandbox on Linux. Writes the signature, the module count, the main module's index,
+	// each module's fields and the decoded breadcrumbs, only the module list is needed once the
+	// presubmit response is in.
+	static bool AnalyzeCrashDump(const std::string &path, bool stackwalkSymbols, bool compactSignature, std::string &analysis) {
+		google_breakpad::SymbolSupplier *symbolSupplier = nullptr;
+		google_breakpad::SourceLineResolverInterface *sourceLineResolver = nullptr;
+
+#if defined _LINUX
+		// Unwind with CFI from locally generated symbols where we have them. The resolver is not kept
+		// across dumps as it caches modules by path, which would go stale when a binary is updated.
+		std::unique_ptr<SymbolStoreSupplier> storeSymbolSupplier;
+		std::unique_ptr<google_breakpad::BasicSourceLineResolver> basicSourceLineResolver;
 
-		std::map<const google_breakpad::CodeModule *, unsigned int> moduleMap;
+		if (stackwalkSymbols) {
+			storeSymbolSupplier.reset(new SymbolStoreSupplier(g_symbolstore));
+			basicSourceLineResolver.reset(new google_breakpad::BasicSourceLineResolver());
+			symbolSupplier = storeSymbolSupplier.get();
+			sourceLineResolver = basicSourceLineResolver.get();
+		}
+#endif
 
-		unsigned int moduleCount = processState.modules() ? processState.modules()->module_count() : 0;
-		for (unsigned int moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex) {
-			auto module = processState.modules()->GetModuleAtIndex(moduleIndex);
-			moduleMap[module] = moduleIndex;
+		google_breakpad::ProcessState processState;
+		google_breakpad::MinidumpProcessor minidumpProcessor(symbolSupplier, sourceLineResolver);
 
-			auto debugFile = google_breakpad::PathnameStripper::File(module->debug_file());
-			auto debugIdentifier = module->debug_identifier();
+		{
+			ClogInhibitor clogInhibitor;
+			if (minidumpProcessor.Process(path.c_str(), &processState) != google_breakpad::PROCESS_OK) {
+				return false;
+			}
+		}
 
-			summaryStream << "|M|" << debugFile << "|" << debugIdentifier;
+		std::string signature;
+		if (!(compactSignature ? BuildCompactCrashSignature(processState, signature) : BuildCrashSignature(processState, signature))) {
+			return false;
 		}
 
-		for (int frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
-			auto frame = stack->frames()->at(frameIndex);
+		const google_breakpad::CodeModules *modules = processState.modules();
+		unsigned int moduleCount = modules ? modules->module_count() : 0;
+		const google_breakpad::CodeModule *mainModule = modules ? modules->GetMainModule() : nullptr;
 
-			int moduleIndex = -1;
-			auto moduleOffset = frame->ReturnAddress();
-			if (frame->module) {
-				moduleIndex = moduleMap[frame->module];
-				moduleOffset -= frame->module->base_address();
+		unsigned int mainModuleIndex = 0;
+		for (unsigned int i = 0; i < moduleCount; ++i) {
+			if (modules->GetModuleAtIndex(i) == mainModule) {
+				mainModuleIndex = i;
+				break;
 			}
+		}
+
+		AppendString(analysis, signature);
+		AppendInteger(analysis, moduleCount);
+		AppendInteger(analysis, mainModuleIndex);
+
+		for (unsigned int i = 0; i < moduleCount; ++i) {
+			const google_breakpad::CodeModule *module = modules->GetModuleAtIndex(i);
+			AppendInteger(analysis, module->base_address());
+			AppendInteger(analysis, module->size());
+			AppendString(analysis, module->code_file());
+			AppendString(analysis, module->code_identifier());
+			AppendString(analysis, module->debug_file());
+			AppendString(analysis, module->debug_identifier());
+			AppendString(analysis, module->version());
+		}
 
-			summaryStream << "|F|" << moduleIndex << "|" << std::hex << moduleOffset << std::dec;
+		std::string breadcrumbs;
+		if (!Breadcrumbs::Decode(path.c_str(), breadcrumbs)) {
+			breadcrumbs.clear();
 		}
 
-		auto summaryLine = summaryStream.str();
-		// printf("%s\n", summaryLine.c_str());
+		AppendString(analysis, breadcrumbs);
+		return true;
+	}
 
+	IWebForm *CreatePresubmitForm() {
 		IWebForm *form = webternet->CreateForm();
 
 		const char *minidumpAccount = g_pSM->GetCoreConfigValue("MinidumpAccount");
@@ -890,8 +1752,10 @@ class UploadThread: public IThread
 		form->AddString("ExtensionVersion", SMEXT_CONF_VERSION);
 		form->AddString("ServerID", serverId);
 
-		form->AddString("CrashSignature", summaryLine.c_str());
+		return form;
+	}
 
+	bool PostPresubmit(IWebForm *form, uint64_t bytes, std::string &response) {
 		MemoryDownloader data;
 		IWebTransfer *xfer = webternet->CreateSession();
 		xfer->SetFailOnHTTPError(true);
@@ -899,31 +1763,122 @@ class UploadThread: public IThread
 		const char *minidumpUrl = g_pSM->GetCoreConfigValue("MinidumpUrl");
 		if (!minidumpUrl) minidumpUrl = "http://crash.limetech.org/submit";
 
+		if (!ThrottleUpload(bytes)) {
+			return false;
+		}
+
+		auto presubmitStart = std::chrono::steady_clock::now();
 		bool uploaded = xfer->PostAndDownload(minidumpUrl, form, &data, NULL);
+		RecordStage(kUSPresubmit, presubmitStart, bytes, uploaded);
 
 		if (!uploaded) {
-			if (log) fprintf(log, "Presubmit failed: %s (%d)\n", xfer->LastErrorMessage(), xfer->LastErrorCode());
+			Log("Presubmit failed: %s (%d)", xfer->LastErrorMessage(), xfer->LastErrorCode());
+			return false;
+		}
+
+		response.assign(data.GetBuffer(), data.GetSize());
+		return true;
+	}
+
+	// Sends the signatures of every pending dump in one request, as CrashSignatureCount and
+	// CrashSignature0..N-1. The server answers with one line per dump, in order, each in the
+	// same format as a single presubmit response. Dumps left without a response go through the
+	// single presubmit path.
+	void BatchPresubmitCrashDumps(std::vector<PendingDump> &pending) {
+		IWebForm *form = CreatePresubmitForm();
+
+		char fieldName[64];
+		unsigned int signatureCount = 0;
+		uint64_t signatureBytes = 0;
+		std::vector<PendingDump *> submitted;
+
+		for (auto &dump : pending) {
+			currentDump = dump.name;
+			if (!ProcessCrashDump(dump)) {
+				dump.processingFailed = true;
+				continue;
+			}
+
+			g_pSM->Format(fieldName, sizeof(fieldName), "CrashSignature%u", signatureCount++);
+			form->AddString(fieldName, dump.signature.c_str());
+			signatureBytes += dump.signature.size();
+			submitted.push_back(&dump);
+		}
+
+		currentDump.clear();
+
+		if (submitted.empty()) {
+			return;
+		}
+
+		g_pSM->Format(fieldName, sizeof(fieldName), "%u", signatureCount);
+		form->AddString("CrashSignatureCount", fieldName);
+
+		std::string response;
+		if (!PostPresubmit(form, signatureBytes, response)) {
+			Log("Batch presubmit of %u dumps failed, presubmitting individually", signatureCount);
+			return;
+		}
+
+		size_t lineStart = 0;
+		for (auto dump : submitted) {
+			if (lineStart >= response.size()) {
+				break;
+			}
+
+			size_t lineEnd = response.find('\n', lineStart);
+			if (lineEnd == std::string::npos) {
+				lineEnd = response.size();
+			}
+
+			dump->presubmitResponse = response.substr(lineStart, lineEnd - lineStart);
+			dump->batched = true;
+			lineStart = lineEnd + 1;
+		}
+
+		Log("Batch presubmitted %u dumps", signatureCount);
+	}
+
+	PresubmitResponse PresubmitCrashDump(PendingDump &dump, char *tokenBuffer, size_t tokenBufferLength) {
+		if (dump.processingFailed) {
+			return kPRLocalError;
+		}
+
+		if (!dump.processed && !ProcessCrashDump(dump)) {
+			return kPRLocalError;
+		}
+
+		if (dump.batched) {
+			return HandlePresubmitResponse(dump.presubmitResponse, dump, tokenBuffer, tokenBufferLength);
+		}
+
+		IWebForm *form = CreatePresubmitForm();
+		form->AddString("CrashSignature", dump.signature.c_str());
+
+		std::string response;
+		if (!PostPresubmit(form, dump.signature.size(), response)) {
 			return kPRRemoteError;
 		}
 
-		int responseSize = data.GetSize();
-		char *response = new char[responseSize + 1];
-		strncpy(response, data.GetBuffer(), responseSize + 1);
-		response[responseSize] = '\0';
-		while (responseSize > 0 && response[responseSize - 1] == '\n') {
-			response[--responseSize] = '\0';
+		return HandlePresubmitResponse(response, dump, tokenBuffer, tokenBufferLength);
+	}
+
+	PresubmitResponse HandlePresubmitResponse(std::string response, const PendingDump &dump, char *tokenBuffer, size_t tokenBufferLength) {
+		unsigned int moduleCount = dump.modules.size();
+
+		while (!response.empty() && response.back() == '\n') {
+			response.pop_back();
 		}
-		//if (log) fprintf(log, "Presubmit complete: %s\n", response);
+		//Log("Presubmit complete: %s", response.c_str());
 
+		int responseSize = response.size();
 		if (responseSize < 2) {
-			if (log) fprintf(log, "Presubmit response too short\n");
-			delete[] response;
+			Log("Presubmit response too short");
 			return kPRRemoteError;
 		}
 
 		if (response[0] == 'E') {
-			if (log) fprintf(log, "Presubmit error: %s\n", &response[2]);
-			delete[] response;
+			Log("Presubmit error: %s", &response[2]);
 			return kPRRemoteError;
 		}
 
@@ -934,15 +1889,13 @@ class UploadThread: public IThread
 		else return kPRRemoteError;
 
 		if (response[1] != '|') {
-			if (log) fprintf(log, "Response delimiter missing\n");
-			delete[] response;
+			Log("Response delimiter missing");
 			return kPRRemoteError;
 		}
 
 		unsigned int responseCount = responseSize - 2;
 		if (responseCount < moduleCount) {
-			if (log) fprintf(log, "Response module list doesn't match sent list (%d < %d)\n", responseCount, moduleCount);
-			delete[] response;
+			Log("Response module list doesn't match sent list (%d < %d)", responseCount, moduleCount);
 			return presubmitResponse;
 		}
 
@@ -960,20 +1913,15 @@ class UploadThread: public IThread
 				tokenBuffer[tokenLength] = '\0';
 			}
 
-			if (log) fprintf(log, "Got a presubmit token from server: %s\n", tokenBuffer);
+			Log("Got a presubmit token from server: %s", tokenBuffer);
 		}
 
 		if (moduleCount > 0) {
-			auto mainModule = processState.modules()->GetMainModule();
+			auto mainModule = dump.modules[dump.mainModule].get();
 			auto executableBaseDir = PathnameStripper_Directory(mainModule->code_file());
-			InitModuleClassificationMap(executableBaseDir);
+			moduleClassifier.Init(executableBaseDir, crashGamePath, crashSourceModPath);
 
-			// 0 = Disabled
-			// 1 = System Only
-			// 2 = System + Game
-			// 3 = System + Game + Addons
-			const char *symbolSubmitOptionStr = g_pSM->GetCoreConfigValue("MinidumpSymbolUpload");
-			int symbolSubmitOption = symbolSubmitOptionStr ? atoi(symbolSubmitOptionStr) : 3;
+			int symbolSubmitOption = GetSymbolSubmitOption();
 
 			const char *binarySubmitOption = g_pSM->GetCoreConfigValue("MinidumpBinaryUpload");
 			bool canBinarySubmit = !binarySubmitOption || (tolower(binarySubmitOption[0]) == 'y' || binarySubmitOption[0] == '1');
@@ -989,54 +1937,38 @@ class UploadThread: public IThread
 				if (!submitSymbols && !submitBinary) {
 					continue;
 				}
-				if (log) fprintf(log, "Getting module at index %d\n", moduleIndex);
-				if (log) fflush(log);
-
-				auto module = processState.modules()->GetModuleAtIndex(moduleIndex);
-
-				auto moduleType = ClassifyModule(module);
-				if (log) fprintf(log, "Classified module %s as %s\n", module->code_file().c_str(), ModuleTypeCode[moduleType]);
-				if (log) fflush(log);
-				switch (moduleType) {
-					case kMTUnknown:
-						continue;
-					case kMTSystem:
-						if (symbolSubmitOption < 1) {
-							continue;
-						}
-						break;
-					case kMTGame:
-						if (symbolSubmitOption < 2) {
-							continue;
-						}
-						break;
-					case kMTAddon:
-					case kMTExtension:
-						if (symbolSubmitOption < 3) {
-							continue;
-						}
-						break;
-				}
+				Log("Getting module at index %d", moduleIndex);
 
-				if (canBinarySubmit && submitBinary) {
-					UploadModuleFile(module, tokenBuffer);
-				}
+				auto module = dump.modules[moduleIndex].get();
 
-#if defined _LINUX
-				if (submitSymbols) {
-					UploadSymbolFile(module, tokenBuffer);
+				auto moduleType = moduleClassifier.Classify(module->code_file());
+				Log("Classified module %s as %s", module->code_file().c_str(), ModuleTypeCode[moduleType]);
+				if (!ShouldSubmitModuleType(moduleType, symbolSubmitOption)) {
+					continue;
 				}
-#endif
+
+				// Queued rather than sent here, the crash upload and its ID shouldn't wait for the deferral.
+				ModuleUpload upload;
+				upload.dump = dump.name;
+				upload.presubmitToken = tokenBuffer ? tokenBuffer : "";
+				upload.module.reset(new google_breakpad::BasicCodeModule(module));
+				upload.moduleType = moduleType;
+				upload.binary = canBinarySubmit && submitBinary;
+				upload.symbols = submitSymbols;
+				moduleUploads.push_back(std::move(upload));
 			}
 		}
-		if (log) fprintf(log, "PresubmitCrashDump complete\n");
-		if (log) fflush(log);
+		Log("PresubmitCrashDump complete");
 
-		delete[] response;
 		return presubmitResponse;
 	}
 
 	bool UploadCrashDump(const char *path, const char *metapath, const char *presubmitToken, char *response, int maxlen) {
+		uint64_t minidumpSize = GetFileSize(path);
+		if (minidumpSize >= g_uploadscheduler.GetHeavyUploadSize()) {
+			DeferHeavyWork(minidumpSize);
+		}
+
 		IWebForm *form = webternet->CreateForm();
 
 		const char *minidumpAccount = g_pSM->GetCoreConfigValue("MinidumpAccount");
@@ -1065,7 +1997,17 @@ class UploadThread: public IThread
 		const char *minidumpUrl = g_pSM->GetCoreConfigValue("MinidumpUrl");
 		if (!minidumpUrl) minidumpUrl = "http://crash.limetech.org/submit";
 
+		uint64_t crashSize = minidumpSize + GetFileSize(metapath);
+		if (!ThrottleUpload(crashSize)) {
+			if (response) {
+				g_pSM->Format(response, maxlen, "%llu bytes is more than MinidumpUploadBurst", (unsigned long long)crashSize);
+			}
+			return false;
+		}
+
+		auto crashUploadStart = std::chrono::steady_clock::now();
 		bool uploaded = xfer->PostAndDownload(minidumpUrl, form, &data, NULL);
+		RecordStage(kUSCrashUpload, crashUploadStart, crashSize, uploaded);
 
 		if (response) {
 			if (uploaded) {
@@ -1085,24 +2027,107 @@ class UploadThread: public IThread
 	}
 } uploadThread;
 
-class SourcePawnNotifyThread : public IThread
+#if defined _LINUX
+static int CollectLoadedModule(struct dl_phdr_info *info, size_t size, void *data)
+{
+	// The main executable has an empty name and the vDSO a bare one, neither can be dumped from here.
+	if (!info->dlpi_name || !info->dlpi_name[0] || !strchr(info->dlpi_name, '/')) {
+		return 0;
+	}
+
+	// Resolve the path the way /proc/self/maps (and so the minidump) reports it.
+	char resolvedPath[PATH_MAX];
+	if (realpath(info->dlpi_name, resolvedPath)) {
+		static_cast<std::vector<std::string> *>(data)->push_back(resolvedPath);
+	}
+
+	return 0;
+}
+
+// How long the prewarmer waits before checking again whether a busy server has emptied.
+static const std::chrono::seconds kPrewarmRetryInterval(30);
+
+// Generates symbol files for loaded modules into the symbol store while the server is idle, so the
+// upload thread only has to read them after a crash. Works one module per service thread task and
+// re-queues itself, so it never holds other service work up while waiting for the server to empty.
+class SymbolPrewarmer
 {
+	std::vector<std::string> modules;
+	size_t nextModule = 0;
+	bool listed = false;
+	int symbolSubmitOption = 0;
+	unsigned int generated = 0;
+	ModuleClassifier moduleClassifier;
+
 public:
+	void Step() {
+		if (!g_uploadscheduler.IsIdle()) {
+			g_servicethread.PostDelayed([this]() { Step(); }, kPrewarmRetryInterval);
+			return;
+		}
 
-	void RunThread(IThreadHandle* pHandle) {
-		for (;;) {
-			// Wait until OnMapStart is called once, this should be enough delay to make sure plugins are loaded.
-			if (g_accelerator.IsMapStarted() && g_accelerator.IsDoneUploading()) {
-				extforwards::CallOnDoneUploadingForward();
-				break;
-			}
+		if (!listed) {
+			ListModules();
+			listed = true;
+		}
+
+		if (nextModule < modules.size()) {
+			PrewarmModule(modules[nextModule++]);
+			g_servicethread.Post([this]() { Step(); });
+			return;
+		}
+
+		if (generated > 0) {
+			rootconsole->ConsolePrint("Accelerator prewarmed symbols for %u modules.", generated);
 		}
 	}
 
-	void OnTerminate(IThreadHandle* pHandle, bool cancel) {
+private:
+	void ListModules() {
+		char executablePath[PATH_MAX];
+		ssize_t executablePathLength = readlink("/proc/self/exe", executablePath, sizeof(executablePath) - 1);
+		if (executablePathLength <= 0) {
+			return;
+		}
+
+		executablePath[executablePathLength] = '\0';
+		modules.push_back(executablePath);
+
+		dl_iterate_phdr(CollectLoadedModule, &modules);
+
+		std::string executableBaseDir(executablePath);
+		executableBaseDir.erase(executableBaseDir.rfind('/') + 1);
+		moduleClassifier.Init(executableBaseDir, crashGamePath, crashSourceModPath);
+
+		symbolSubmitOption = GetSymbolSubmitOption();
 	}
 
-} spNotifyThread;
+	void PrewarmModule(const std::string &path) {
+		auto moduleType = moduleClassifier.Classify(path);
+		if (!ShouldSubmitModuleType(moduleType, symbolSubmitOption)) {
+			return;
+		}
+
+		SymbolData symbolData = GetSymbolDataForModule(moduleType);
+
+		std::string debugId;
+		if (!SymbolStore::GetDebugIdentifier(path, debugId) || g_symbolstore.Contains(path, debugId, symbolData)) {
+			return;
+		}
+
+		std::string symbols;
+		auto prewarmStart = std::chrono::steady_clock::now();
+		bool succeeded = DumpSymbolFile(path, symbolData, symbols) && g_symbolstore.Save(symbolData, symbols);
+		uint64_t elapsed = g_uploadstats.Record(kUSSymbolPrewarm, prewarmStart, symbols.size(), succeeded);
+		g_uploadlog.Stage(kUSSymbolPrewarm, nullptr, elapsed, symbols.size(), succeeded);
+		g_uploadlog.Message(nullptr, "%s symbols for %s", succeeded ? "Prewarmed" : "Failed to prewarm", path.c_str());
+
+		if (succeeded) {
+			generated++;
+		}
+	}
+} symbolPrewarmer;
+#endif
 
 class VFuncEmptyClass {};
 
@@ -1141,6 +2166,16 @@ const char *GetCmdLine()
 	return (const char *)(reinterpret_cast<VFuncEmptyClass*>(cmdline)->*u.mfpnew)();
 }
 
+void UploadSchedulerFrameHook(bool simulating)
+{
+	g_uploadscheduler.OnGameFrame(simulating);
+}
+
+void BreadcrumbsFrameHook(bool simulating)
+{
+	g_breadcrumbs.OnGameFrame();
+}
+
 Accelerator::Accelerator() :
 	m_doneuploading(false), m_maphasstarted(false)
 {
@@ -1163,6 +2198,12 @@ bool Accelerator::SDK_OnLoad(char *error, size_t maxlength, bool late)
 		}
 	}
 
+	g_dumpstorage.Init(dumpStoragePath);
+
+#if defined _LINUX
+	g_sandbox.Init();
+#endif
+
 	g_pSM->BuildPath(Path_SM, logPath, sizeof(logPath), "logs/accelerator.log");
 
 	// Get these early so the upload thread can use them.
@@ -1170,13 +2211,69 @@ bool Accelerator::SDK_OnLoad(char *error, size_t maxlength, bool late)
 	strncpy(crashSourceModPath, g_pSM->GetSourceModPath(), sizeof(crashSourceModPath) - 1);
 	strncpy(crashGameDirectory, g_pSM->GetGameFolderName(), sizeof(crashGameDirectory) - 1);
 
-	threader->MakeThread(&uploadThread);
-	threader->MakeThread(&spNotifyThread); // This thread waits for accelator to be done uploading and for the first OnMapStart call, then fires a SourceMod forward
+	g_pSM->AddGameFrameHook(UploadSchedulerFrameHook);
+	g_pSM->AddGameFrameHook(BreadcrumbsFrameHook);
+
+#if defined _LINUX
+	char symbolStorePath[512];
+	g_pSM->BuildPath(Path_SM, symbolStorePath, sizeof(symbolStorePath), "data/dumps/symbols");
+	bool haveSymbolStore = libsys->IsPathDirectory(symbolStorePath) || libsys->CreateFolder(symbolStorePath);
+	if (haveSymbolStore) {
+		g_symbolstore.Init(symbolStorePath);
+	} else {
+		smutils->LogMessage(myself, "WARNING: Failed to create symbol store %s, symbols will be generated at upload time", symbolStorePath);
+	}
+
+	char processSnapshotPath[512];
+	g_pSM->BuildPath(Path_SM, processSnapshotPath, sizeof(processSnapshotPath), "data/dumps/processes");
+	g_coredumpconverter.Init(processSnapshotPath);
+
+	const char *crashUploaderOption = g_pSM->GetCoreConfigValue("MinidumpCrashUploader");
+	if (crashUploaderOption && crashUploaderOption[0]) {
+		if (crashUploaderOption[0] == '/') {
+			ke::SafeStrcpy(crashUploaderPath, sizeof(crashUploaderPath), crashUploaderOption);
+		} else {
+			g_pSM->BuildPath(Path_SM, crashUploaderPath, sizeof(crashUploaderPath), "%s", crashUploaderOption);
+		}
+
+		if (access(crashUploaderPath, X_OK) != 0) {
+			smutils->LogMessage(myself, "WARNING: Crash uploader %s is not executable, crashes will be uploaded on the next start", crashUploaderPath);
+			crashUploaderPath[0] = '\0';
+		}
+
+		const char *minidumpUrl = g_pSM->GetCoreConfigValue("MinidumpUrl");
+		ke::SafeStrcpy(crashUploadUrl, sizeof(crashUploadUrl), minidumpUrl ? minidumpUrl : "http://crash.limetech.org/submit");
+
+		// Every descriptor the crashed process may have open is closed before the exec.
+		struct rlimit fileLimit;
+		if (getrlimit(RLIMIT_NOFILE, &fileLimit) == 0) {
+			crashUploaderMaxFd = (fileLimit.rlim_cur == RLIM_INFINITY || fileLimit.rlim_cur > 65536) ? 65536 : (int)fileLimit.rlim_cur;
+		}
+	}
+#endif
+
+	g_uploadlog.Start(logPath);
+	g_servicethread.Start();
+	g_servicethread.Post([]() { uploadThread.Run(); });
+
+#if defined _LINUX
+	const char *prewarmOption = g_pSM->GetCoreConfigValue("MinidumpSymbolPrewarm");
+	if (haveSymbolStore && prewarmOption && (tolower(prewarmOption[0]) == 'y' || prewarmOption[0] == '1')) {
+		g_servicethread.Post([]() { symbolPrewarmer.Step(); });
+	}
+#endif
+
+	// Captured by the extension itself where tier0 allows, the GetSpew signature is only a fallback.
+	g_consolehistory.Start();
 
 	do {
 		char gameconfigError[256];
 		if (!gameconfs->LoadGameConfigFile("accelerator.games", &gameconfig, gameconfigError, sizeof(gameconfigError))) {
-			smutils->LogMessage(myself, "WARNING: Failed to load gamedata file, console output and command line will not be included in crash reports: %s", gameconfigError);
+			smutils->LogMessage(myself, "WARNING: Failed to load gamedata file, %s will not be included in crash reports: %s", g_consolehistory.IsCapturing() ? "command line" : "console output and command line", gameconfigError);
+			break;
+		}
+
+		if (g_consolehistory.IsCapturing()) {
 			break;
 		}
 
@@ -1234,6 +2331,39 @@ bool Accelerator::SDK_OnLoad(char *error, size_t maxlength, bool late)
 #error Bad platform.
 #endif
 
+	g_breadcrumbs.Init();
+	handler->RegisterAppMemory(g_breadcrumbs.GetBuffer(), g_breadcrumbs.GetBufferSize());
+
+	if (g_consolehistory.IsCapturing()) {
+		handler->RegisterAppMemory(g_consolehistory.GetBuffer(), g_consolehistory.GetBufferSize());
+	}
+
+#if defined _LINUX
+	mainThread = pthread_self();
+	mainThreadId = sys_gettid();
+#elif defined _WINDOWS
+	mainThreadId = GetCurrentThreadId();
+#endif
+
+	if (g_hangwatchdog.Start(WriteHangDump)) {
+#if defined _LINUX
+		// The first check is a whole timeout away, well after the signal is claimed.
+		hangDumpSignalClaimed = ClaimRealtimeSignal(HANG_DUMP_SIGNAL, HangDumpSignalHandler);
+		if (!hangDumpSignalClaimed) {
+			g_hangwatchdog.Shutdown();
+			smutils->LogMessage(myself, "WARNING: Signal %d already has a handler, the hang watchdog is disabled", HANG_DUMP_SIGNAL);
+		}
+#endif
+	}
+
+#if defined _LINUX
+	char hitchPath[512];
+	g_pSM->BuildPath(Path_SM, hitchPath, sizeof(hitchPath), "data/dumps/hitches");
+	g_hitchsampler.Start(hitchPath);
+#endif
+
+	g_memorymonitor.Start(WriteMemoryDump);
+
 	do {
 		char spJitPath[512];
 		g_pSM->BuildPath(Path_SM, spJitPath, sizeof(spJitPath), "bin/" PLATFORM_ARCH_FOLDER "sourcepawn.jit.x86." PLATFORM_LIB_EXT);
@@ -1273,6 +2403,7 @@ bool Accelerator::SDK_OnLoad(char *error, size_t maxlength, bool late)
 	} while(false);
 
 	plsys->AddPluginsListener(this);
+	rootconsole->AddRootConsoleCommand3("accelerator", "Accelerator crash handler", this);
 
 	IPluginIterator *iterator = plsys->GetPluginIterator();
 	while (iterator->MorePlugins()) {
@@ -1342,6 +2473,10 @@ bool Accelerator::SDK_OnLoad(char *error, size_t maxlength, bool late)
 		}
 	}
 
+#if defined _LINUX
+	UpdateProcessSnapshot(true);
+#endif
+
 	if (late) {
 		this->OnCoreMapStart(NULL, 0, 0);
 	}
@@ -1351,8 +2486,25 @@ bool Accelerator::SDK_OnLoad(char *error, size_t maxlength, bool late)
 
 void Accelerator::SDK_OnUnload()
 {
+	g_consolehistory.Stop();
+	g_hangwatchdog.Shutdown();
+	g_memorymonitor.Shutdown();
+#if defined _LINUX
+	if (hangDumpSignalClaimed) {
+		ReleaseRealtimeSignal(HANG_DUMP_SIGNAL);
+		hangDumpSignalClaimed = false;
+	}
+
+	g_hitchsampler.Shutdown();
+	g_sandbox.Shutdown();
+#endif
+	g_servicethread.Shutdown();
+	g_uploadlog.Shutdown();
+	g_pSM->RemoveGameFrameHook(UploadSchedulerFrameHook);
+	g_pSM->RemoveGameFrameHook(BreadcrumbsFrameHook);
 	extforwards::Shutdown();
 	plsys->RemovePluginsListener(this);
+	rootconsole->RemoveRootConsoleCommand("accelerator", this);
 
 #if defined _LINUX
 	g_pSM->RemoveGameFrameHook(OnGameFrame);
@@ -1382,94 +2534,97 @@ void Accelerator::OnCoreMapStart(edict_t *pEdictList, int edictCount, int client
 {
 	strncpy(crashMap, gamehelpers->GetCurrentMap(), sizeof(crashMap) - 1);
 	m_maphasstarted.store(true);
-}
 
-/* 010 Editor Template
-uint64 headerMagic;
-uint32 version;
-uint32 size;
-uint32 count;
-struct {
-    uint32 size;
-    uint32 context <format=hex>;
-    char file[];
-    uint32 count;
-    struct {
-        uint32 pcode <format=hex>;
-        char name[];
-    } functions[count] <optimize=false>;
-} plugins[count] <optimize=false>;
-uint64 tailMagic;
-*/
+	g_breadcrumbs.Add(kBCMapStart, crashMap);
+	g_hangwatchdog.SetLevelChanging(false);
 
-unsigned char *serializedPluginContexts = nullptr;
-std::map<const IPluginContext *, unsigned char *> pluginContextMap;
+#if defined _LINUX
+	// Also picks up modules loaded since the last snapshot.
+	UpdateProcessSnapshot(false);
+#endif
+}
 
-void SerializePluginContexts()
+void Accelerator::OnCoreMapEnd()
 {
-	if (serializedPluginContexts) {
-		handler->UnregisterAppMemory(serializedPluginContexts);
-		free(serializedPluginContexts);
-		serializedPluginContexts = nullptr;
-	}
+	g_breadcrumbs.Add(kBCMapEnd, crashMap);
+	g_hangwatchdog.SetLevelChanging(true);
+}
+
+void Accelerator::OnRootConsoleCommand(const char *cmdname, const ICommandArgs *args)
+{
+	const char *subcommand = (args->ArgC() >= 3) ? args->Arg(2) : "";
 
-	uint32_t count = pluginContextMap.size();
-	if (count == 0) {
+	if (strcmp(subcommand, "stats") == 0) {
+		rootconsole->ConsolePrint("  %-20s %8s %8s %10s %10s %12s %12s", "Stage", "Count", "Failed", "Total ms", "Max ms", "Bytes", "Max bytes");
+		for (int stage = 0; stage < kUSCount; ++stage) {
+			auto stats = g_uploadstats.Get(static_cast<UploadStage>(stage));
+			rootconsole->ConsolePrint("  %-20s %8llu %8llu %10llu %10llu %12llu %12llu", UploadStageName[stage],
+				(unsigned long long)stats.count, (unsigned long long)stats.failures,
+				(unsigned long long)(stats.totalMicroseconds / 1000), (unsigned long long)(stats.maxMicroseconds / 1000),
+				(unsigned long long)stats.bytes, (unsigned long long)stats.maxBytes);
+		}
 		return;
 	}
 
-	uint32_t size = 0;
-	size += sizeof(uint64_t); // header magic
-	size += sizeof(uint32_t); // version
-	size += sizeof(uint32_t); // size
-	size += sizeof(uint32_t); // count
-
-	for (auto &it : pluginContextMap) {
-		unsigned char *buffer = it.second;
-
-		uint32_t bufferSize;
-		memcpy(&bufferSize, buffer, sizeof(uint32_t));
-
-		size += bufferSize;
+	if (strcmp(subcommand, "snapshot") == 0) {
+		const char *reason = (args->ArgC() >= 4) ? args->Arg(3) : "console";
+		if (WriteSnapshot(reason)) {
+			rootconsole->ConsolePrint("[Accelerator] Writing snapshot, it will be uploaded with the crash dumps on the next start.");
+		} else {
+			rootconsole->ConsolePrint("[Accelerator] Failed to write snapshot, another one may still be in progress.");
+		}
+		return;
 	}
 
-	size += sizeof(uint64_t); // tail magic
+	rootconsole->ConsolePrint("SourceMod Accelerator Menu:");
+	rootconsole->DrawGenericOption("stats", "Show upload pipeline timing and byte counters");
+	rootconsole->DrawGenericOption("snapshot", "Write a minidump of the running server, with an optional reason");
+}
 
-	serializedPluginContexts = (unsigned char *)malloc(size);
-	handler->RegisterAppMemory(serializedPluginContexts, size);
-	unsigned char *cursor = serializedPluginContexts;
+bool Accelerator::WriteSnapshot(const char *reason)
+{
+	char sanitized[Breadcrumbs::kMessageSize];
+	ke::SafeStrcpy(sanitized, sizeof(sanitized), reason);
 
-	uint64_t headerMagic = 103582791429521979ULL;
-	memcpy(cursor, &headerMagic, sizeof(uint64_t));
-	cursor += sizeof(uint64_t);
+	// The reason ends up on a single metadata line.
+	for (char *c = sanitized; *c; ++c) {
+		if (*c == '\r' || *c == '\n') {
+			*c = ' ';
+		}
+	}
 
-	uint32_t version = 1;
-	memcpy(cursor, &version, sizeof(uint32_t));
-	cursor += sizeof(uint32_t);
+	g_breadcrumbs.Add(kBCSnapshot, sanitized);
 
-	memcpy(cursor, &size, sizeof(uint32_t));
-	cursor += sizeof(uint32_t);
+	bool written = WriteSnapshotDump(sanitized);
+	g_uploadlog.Message(nullptr, "%s snapshot: %s", written ? "Requested" : "Failed to request", sanitized);
+	return written;
+}
 
-	memcpy(cursor, &count, sizeof(uint32_t));
-	cursor += sizeof(uint32_t);
+PluginContextMap pluginContextMap;
 
-	for (auto &it : pluginContextMap) {
-		unsigned char *buffer = it.second;
+void SerializePluginContexts()
+{
+	std::lock_guard<std::mutex> lock(pluginContextsMutex);
 
-		uint32_t bufferSize;
-		memcpy(&bufferSize, buffer, sizeof(uint32_t));
+	if (serializedPluginContexts) {
+		handler->UnregisterAppMemory(serializedPluginContexts);
+		free(serializedPluginContexts);
+		serializedPluginContexts = nullptr;
+	}
 
-		memcpy(cursor, buffer, bufferSize);
-		cursor += bufferSize;
+	serializedPluginContextsSize = 0;
+	serializedPluginContexts = SerializePluginContextMap(pluginContextMap, serializedPluginContextsSize);
+	if (!serializedPluginContexts) {
+		return;
 	}
 
-	uint64_t tailMagic = 76561197987819599ULL;
-	memcpy(cursor, &tailMagic, sizeof(uint64_t));
-	cursor += sizeof(uint64_t);
+	handler->RegisterAppMemory(serializedPluginContexts, serializedPluginContextsSize);
 }
 
 void Accelerator::OnPluginLoaded(IPlugin *plugin)
 {
+	g_breadcrumbs.Add(kBCPluginLoad, plugin->GetFilename());
+
 	IPluginRuntime *runtime = plugin->GetRuntime();
 	IPluginContext *context = plugin->GetBaseContext();
 	if (!runtime || !context) {
@@ -1529,6 +2684,8 @@ void Accelerator::OnPluginLoaded(IPlugin *plugin)
 
 void Accelerator::OnPluginUnloaded(IPlugin *plugin)
 {
+	g_breadcrumbs.Add(kBCPluginUnload, plugin->GetFilename());
+
 	IPluginContext *context = plugin->GetBaseContext();
 	if (!context) {
 		return;
@@ -1543,24 +2700,25 @@ void Accelerator::OnPluginUnloaded(IPlugin *plugin)
 	SerializePluginContexts();
 }
 
-void Accelerator::StoreUploadedCrash(UploadedCrash& crash)
+int Accelerator::StoreUploadedCrash(UploadedCrash& crash)
 {
-	std::lock_guard<std::mutex> lock(m_uploadedcrashes_mutex);
-	m_uploadedcrashes.push_back(std::move(crash));
+	int index = static_cast<int>(m_uploadedcrashes.Append(std::move(crash)));
+
+	extforwards::CallOnCrashUploadedForward(index);
+
+	return index;
 }
 
 const UploadedCrash* Accelerator::GetUploadedCrash(int element) const
 {
-	std::lock_guard<std::mutex> lock(m_uploadedcrashes_mutex);
-	if (element < 0 || element >= static_cast<int>(m_uploadedcrashes.size())) {
+	if (element < 0) {
 		return nullptr;
 	}
 
-	return &m_uploadedcrashes[element];
+	return m_uploadedcrashes.Get(static_cast<size_t>(element));
 }
 
 cell_t Accelerator::GetUploadedCrashCount() const
 {
-	std::lock_guard<std::mutex> lock(m_uploadedcrashes_mutex);
-	return static_cast<cell_t>(m_uploadedcrashes.size());
+	return static_cast<cell_t>(m_uploadedcrashes.Size());
 }
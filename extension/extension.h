@@ -28,8 +28,8 @@
 
 #include <atomic>
 #include <vector>
-#include <mutex>
 #include "smsdk_ext.h"
+#include "AppendOnlyList.h"
 
 /**
  * @brief Represents a crash that has been successfully uploaded to Accelerator's backend
@@ -51,7 +51,7 @@ private:
 /**
  * @brief Sample implementation of the SDK Extension.
  */
-class Accelerator : public SDKExtension, IPluginsListener
+class Accelerator : public SDKExtension, IPluginsListener, IRootConsoleCommand
 {
 public: // SDKExtension
 	Accelerator();
@@ -85,6 +85,11 @@ public: // SDKExtension
 	 */
 	virtual void OnCoreMapStart(edict_t *pEdictList, int edictCount, int clientMax);
 
+	/**
+	 * @brief Called on level shutdown.
+	 */
+	virtual void OnCoreMapEnd();
+
 public: // IPluginsListener
 	/**
 	 * @brief Called when a plugin is fully loaded successfully.
@@ -96,14 +101,24 @@ public: // IPluginsListener
 	 */
 	virtual void OnPluginUnloaded(IPlugin *plugin);
 
+public: // IRootConsoleCommand
+	/**
+	 * @brief Handles the "sm accelerator" root console command.
+	 */
+	virtual void OnRootConsoleCommand(const char *cmdname, const ICommandArgs *args);
+
+public:
+
 	/**
-	 * @brief Stores an uploaded crash into the vector.
+	 * @brief Stores an uploaded crash and queues the Accelerator_OnCrashUploaded forward for it.
 	 * @param crash Uploaded crash instance to store.
+	 * @return Index of the stored crash.
 	 */
-	void StoreUploadedCrash(UploadedCrash& crash);
+	int StoreUploadedCrash(UploadedCrash& crash);
 	/**
-	 * @brief Retrieves an uploaded crash from the given element.
-	 * @param element Vector element (index) to read.
+	 * @brief Retrieves an uploaded crash from the given element. Lock-free.
+	 * @note Stored crashes are never moved, the returned pointer stays valid while uploads continue.
+	 * @param element Element (index) to read.
 	 * @return Upload crash if found or NULL if out of bounds.
 	 */
 	const UploadedCrash* GetUploadedCrash(int element) const;
@@ -126,11 +141,17 @@ public: // IPluginsListener
 	 * @return True if yes, false otherwise.
 	 */
 	bool IsMapStarted() const { return m_maphasstarted.load(); }
+	/**
+	 * @brief Writes a minidump of the running server, uploaded on the next start tagged as a snapshot. Main thread only.
+	 * @note On Linux the dump is written by a forked child, the game thread only waits for the fork.
+	 * @param reason Recorded in the dump metadata, truncated to a breadcrumb's length.
+	 * @return False if the dump couldn't be started, or if another snapshot is still being written.
+	 */
+	bool WriteSnapshot(const char *reason);
 
 private:
-	std::vector<UploadedCrash> m_uploadedcrashes; // Vector of uploaded crashes
+	AppendOnlyList<UploadedCrash> m_uploadedcrashes; // Uploaded crashes, appended by the upload thread and read lock-free by natives
 	std::vector<sp_nativeinfo_t> m_natives; // Vector of SourcePawn natives
-	mutable std::mutex m_uploadedcrashes_mutex; // mutex for accessing the m_uploadedcrashes vector
 	std::atomic_bool m_doneuploading; // Signals that Accelerator is done uploading crashes.
 	std::atomic_bool m_maphasstarted; // Signals that OnMapStart has been called at least once.
 };
@@ -5,18 +5,44 @@
 
 
 static SourceMod::IForward* s_ondoneuploadingforward = nullptr;
+static SourceMod::IForward* s_oncrashuploadedforward = nullptr;
 
 static void OnDoneUploadingCallback(void* data)
 {
+	// Wait until OnMapStart is called once, this should be enough delay to make sure plugins are loaded.
+	if (!g_accelerator.IsMapStarted()) {
+		smutils->AddFrameAction(OnDoneUploadingCallback, data);
+		return;
+	}
+
 	if (s_ondoneuploadingforward) {
 		s_ondoneuploadingforward->Execute();
 	}
 }
 
+static void OnCrashUploadedCallback(void* data)
+{
+	// Plugins are loaded on map start, hold the forward until then so early uploads aren't missed.
+	if (!g_accelerator.IsMapStarted()) {
+		smutils->AddFrameAction(OnCrashUploadedCallback, data);
+		return;
+	}
+
+	int index = static_cast<int>(reinterpret_cast<intptr_t>(data));
+	const UploadedCrash* crash = g_accelerator.GetUploadedCrash(index);
+
+	if (s_oncrashuploadedforward && crash) {
+		s_oncrashuploadedforward->PushCell(index);
+		s_oncrashuploadedforward->PushString(crash->GetHTTPResponse().c_str());
+		s_oncrashuploadedforward->Execute();
+	}
+}
+
 
 void extforwards::Init()
 {
 	s_ondoneuploadingforward = forwards->CreateForward("Accelerator_OnDoneUploadingCrashes", SourceMod::ExecType::ET_Ignore, 0, nullptr);
+	s_oncrashuploadedforward = forwards->CreateForward("Accelerator_OnCrashUploaded", SourceMod::ExecType::ET_Ignore, 2, nullptr, Param_Cell, Param_String);
 }
 
 void extforwards::Shutdown()
@@ -25,6 +51,11 @@ void extforwards::Shutdown()
 		forwards->ReleaseForward(s_ondoneuploadingforward);
 		s_ondoneuploadingforward = nullptr;
 	}
+
+	if (s_oncrashuploadedforward) {
+		forwards->ReleaseForward(s_oncrashuploadedforward);
+		s_oncrashuploadedforward = nullptr;
+	}
 }
 
 void extforwards::CallOnDoneUploadingForward()
@@ -34,3 +65,8 @@ void extforwards::CallOnDoneUploadingForward()
 	smutils->AddFrameAction(OnDoneUploadingCallback, nullptr);
 }
 
+void extforwards::CallOnCrashUploadedForward(int index)
+{
+	smutils->AddFrameAction(OnCrashUploadedCallback, reinterpret_cast<void*>(static_cast<intptr_t>(index)));
+}
+
@@ -9,6 +9,8 @@ namespace extforwards
 	void Shutdown();
 	// Calls the on done uploadind forward. (thread safe)
 	void CallOnDoneUploadingForward();
+	// Calls the on crash uploaded forward for the given crash index. (thread safe)
+	void CallOnCrashUploadedForward(int index);
 }
 
 
@@ -2,6 +2,9 @@
 #include <amtl/am-string.h>
 #include "extension.h"
 #include "natives.h"
+#include "UploadStats.h"
+#include "Breadcrumbs.h"
+#include "CrashAnnotations.h"
 
 static cell_t Native_GetUploadedCrashCount(IPluginContext* context, const cell_t* params)
 {
@@ -19,11 +22,6 @@ static cell_t Native_IsDoneUploadingCrashes(IPluginContext* context, const cell_
 
 static cell_t Native_GetCrashHTTPResponse(IPluginContext* context, const cell_t* params)
 {
-	if (!g_accelerator.IsDoneUploading()) {
-		context->ReportError("Wait until accelerator is done uploading crashes before accessing crash information!");
-		return 0;
-	}
-
 	int element = static_cast<int>(params[1]);
 	const UploadedCrash* crash = g_accelerator.GetUploadedCrash(element);
 
@@ -42,12 +40,115 @@ static cell_t Native_GetCrashHTTPResponse(IPluginContext* context, const cell_t*
 	return 0;
 }
 
+// Keep in sync with AcceleratorStat in accelerator.inc
+enum StageStat {
+	kSSCount,
+	kSSFailures,
+	kSSTotalTime,
+	kSSMaxTime,
+	kSSBytes,
+	kSSMaxBytes,
+};
+
+static cell_t ClampToCell(uint64_t value)
+{
+	if (value > 0x7FFFFFFF) {
+		return 0x7FFFFFFF;
+	}
+
+	return static_cast<cell_t>(value);
+}
+
+static cell_t Native_GetStageStat(IPluginContext* context, const cell_t* params)
+{
+	int stage = static_cast<int>(params[1]);
+	if (stage < 0 || stage >= kUSCount) {
+		context->ReportError("Invalid stage %i!", stage);
+		return 0;
+	}
+
+	auto stats = g_uploadstats.Get(static_cast<UploadStage>(stage));
+
+	switch (params[2]) {
+		case kSSCount:
+			return ClampToCell(stats.count);
+		case kSSFailures:
+			return ClampToCell(stats.failures);
+		case kSSTotalTime:
+			return ClampToCell(stats.totalMicroseconds / 1000);
+		case kSSMaxTime:
+			return ClampToCell(stats.maxMicroseconds / 1000);
+		case kSSBytes:
+			return ClampToCell(stats.bytes);
+		case kSSMaxBytes:
+			return ClampToCell(stats.maxBytes);
+	}
+
+	context->ReportError("Invalid stat %i!", params[2]);
+	return 0;
+}
+
+static cell_t Native_AddBreadcrumb(IPluginContext* context, const cell_t* params)
+{
+	char message[Breadcrumbs::kMessageSize];
+
+	IPlugin *plugin = plsys->FindPluginByContext(context->GetContext());
+	size_t length = ke::SafeSprintf(message, sizeof(message), "%s: ", plugin ? plugin->GetFilename() : "unknown");
+
+	smutils->FormatString(&message[length], sizeof(message) - length, context, params, 1);
+
+	g_breadcrumbs.Add(kBCPlugin, message);
+	return 0;
+}
+
+static cell_t Native_WriteSnapshot(IPluginContext* context, const cell_t* params)
+{
+	char reason[Breadcrumbs::kMessageSize];
+
+	IPlugin *plugin = plsys->FindPluginByContext(context->GetContext());
+	size_t length = ke::SafeSprintf(reason, sizeof(reason), "%s: ", plugin ? plugin->GetFilename() : "unknown");
+
+	smutils->FormatString(&reason[length], sizeof(reason) - length, context, params, 1);
+
+	return g_accelerator.WriteSnapshot(reason) ? 1 : 0;
+}
+
+static cell_t Native_SetCrashAnnotation(IPluginContext* context, const cell_t* params)
+{
+	char *key;
+	context->LocalToString(params[1], &key);
+
+	if (!CrashAnnotations::IsValidKey(key)) {
+		context->ReportError("Invalid crash annotation key \"%s\"", key);
+		return 0;
+	}
+
+	char value[CrashAnnotations::kValueSize];
+	smutils->FormatString(value, sizeof(value), context, params, 2);
+
+	return g_crashannotations.Set(key, value) ? 1 : 0;
+}
+
+static cell_t Native_ClearCrashAnnotation(IPluginContext* context, const cell_t* params)
+{
+	char *key;
+	context->LocalToString(params[1], &key);
+
+	g_crashannotations.Clear(key);
+	return 0;
+}
+
 void natives::Setup(std::vector<sp_nativeinfo_t>& vec)
 {
 	sp_nativeinfo_t list[] = {
 		{"Accelerator_GetUploadedCrashCount", Native_GetUploadedCrashCount},
 		{"Accelerator_IsDoneUploadingCrashes", Native_IsDoneUploadingCrashes},
 		{"Accelerator_GetCrashHTTPResponse", Native_GetCrashHTTPResponse},
+		{"Accelerator_GetStageStat", Native_GetStageStat},
+		{"Accelerator_AddBreadcrumb", Native_AddBreadcrumb},
+		{"Accelerator_WriteSnapshot", Native_WriteSnapshot},
+		{"Accelerator_SetCrashAnnotation", Native_SetCrashAnnotation},
+		{"Accelerator_ClearCrashAnnotation", Native_ClearCrashAnnotation},
 	};
 
 	vec.insert(vec.end(), std::begin(list), std::end(list));
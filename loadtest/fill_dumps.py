@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Fills a dumps directory with N minidumps and .txt sidecars for load testing.
+#
+# Minidumps are copied from one or more seed dumps (round-robin) under fresh
+# breakpad-style names, so the real upload thread processes them exactly as it
+# would after a crash. Sidecars use the same CONFIG block layout dumpCallback writes.
+
+import argparse
+import os
+import shutil
+import sys
+import uuid
+
+METADATA = """-------- CONFIG BEGIN --------
+Map=%(map)s
+GamePath=%(game_path)s
+CommandLine=./srcds_linux -game %(game)s +map %(map)s
+SourceModPath=%(game_path)s/addons/sourcemod
+GameDirectory=%(game)s
+ExtensionVersion=loadtest
+ExtensionBuild=loadtest
+-------- CONFIG END --------
+-------- CONSOLE HISTORY BEGIN --------
+%(console)s-------- CONSOLE HISTORY END --------
+"""
+
+def main():
+	parser = argparse.ArgumentParser(description='Generate a backlog of minidumps for load testing.')
+	parser.add_argument('dumps', help='Dumps directory (addons/sourcemod/data/dumps)')
+	parser.add_argument('seeds', nargs='+', help='Seed minidump files')
+	parser.add_argument('--count', type=int, default=50, help='Number of dumps to generate')
+	parser.add_argument('--game', default='tf')
+	parser.add_argument('--game-path', default='/srv/srcds/tf')
+	parser.add_argument('--console-lines', type=int, default=200, help='Lines of fake console history per sidecar')
+	parser.add_argument('--no-metadata', action='store_true', help='Do not write .txt sidecars')
+	options = parser.parse_args()
+
+	if not os.path.isdir(options.dumps):
+		os.makedirs(options.dumps)
+
+	console = ''.join('L 01/01/2000 - 00:00:00: loadtest console line %d\n' % i for i in range(options.console_lines))
+
+	total = 0
+	for i in range(options.count):
+		seed = options.seeds[i % len(options.seeds)]
+		path = os.path.join(options.dumps, '%s.dmp' % uuid.uuid4())
+		shutil.copyfile(seed, path)
+		total += os.path.getsize(path)
+
+		if not options.no_metadata:
+			with open(path + '.txt', 'w') as metadata:
+				metadata.write(METADATA % {
+					'map': 'loadtest_%d' % i,
+					'game': options.game,
+					'game_path': options.game_path,
+					'console': console,
+				})
+
+	print('Wrote %d dumps (%d bytes) to %s' % (options.count, total, options.dumps))
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+# Local stand-in for the crash collector, used to load test the upload pipeline.
+#
+# Implements the presubmit/submit (MinidumpUrl), symbol (MinidumpSymbolUrl) and
+# binary (MinidumpBinaryUrl) endpoints with configurable latency and error rates,
+# and prints per-stage throughput and latency when interrupted.
+#
+# Point the server's core.cfg at it:
+#   "MinidumpUrl"        "http://127.0.0.1:8080/submit"
+#   "MinidumpSymbolUrl"  "http://127.0.0.1:8080/symbols/submit"
+#   "MinidumpBinaryUrl"  "http://127.0.0.1:8080/binary/submit"
+
+import argparse
+import base64
+import email.parser
+import email.policy
+import random
+import signal
+import sys
+import threading
+import time
+import uuid
+import zlib
+
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+STAGES = ['presubmit', 'crash', 'symbols', 'binary']
+
+class Stats(object):
+	def __init__(self):
+		self.lock = threading.Lock()
+		self.latencies = dict((stage, []) for stage in STAGES)
+		self.errors = dict((stage, 0) for stage in STAGES)
+		self.bytes = dict((stage, 0) for stage in STAGES)
+		self.first_request = None
+		self.last_crash = None
+
+	def record(self, stage, start, end, size, failed):
+		with self.lock:
+			if self.first_request is None or start < self.first_request:
+				self.first_request = start
+			self.latencies[stage].append(end - start)
+			self.bytes[stage] += size
+			if failed:
+				self.errors[stage] += 1
+			elif stage == 'crash':
+				self.last_crash = end
+
+	def report(self, pid):
+		def percentile(values, p):
+			if not values:
+				return 0.0
+			return values[min(len(values) - 1, int(len(values) * p))]
+
+		with self.lock:
+			print('')
+			print('%-10s %8s %8s %12s %10s %10s %10s %10s' % ('Stage', 'Requests', 'Errors', 'Bytes', 'p50 ms', 'p95 ms', 'p99 ms', 'max ms'))
+			for stage in STAGES:
+				values = sorted(self.latencies[stage])
+				print('%-10s %8d %8d %12d %10.1f %10.1f %10.1f %10.1f' % (stage, len(values), self.errors[stage], self.bytes[stage],
+					percentile(values, 0.50) * 1000, percentile(values, 0.95) * 1000, percentile(values, 0.99) * 1000,
+					(values[-1] if values else 0.0) * 1000))
+
+			crashes = len(self.latencies['crash']) - self.errors['crash']
+			if crashes and self.last_crash > self.first_request:
+				print('')
+				print('%d dumps uploaded in %.2fs (%.2f dumps/s), %d bytes received' % (crashes, self.last_crash - self.first_request,
+					crashes / (self.last_crash - self.first_request), sum(self.bytes.values())))
+
+		if pid:
+			try:
+				with open('/proc/%d/status' % pid, 'r') as status:
+					for line in status:
+						if line.startswith('VmHWM:') or line.startswith('VmRSS:'):
+							print('srcds %s' % line.strip())
+			except IOError as e:
+				print('Could not read memory usage of pid %d: %s' % (pid, e))
+
+def read_varint(data, position):
+	value = 0
+	shift = 0
+	while True:
+		byte = data[position]
+		position += 1
+		value |= (byte & 0x7F) << shift
+		if not byte & 0x80:
+			return value, position
+		shift += 7
+
+def read_string(data, position):
+	length, position = read_varint(data, position)
+	return data[position:position + length].decode('utf-8', 'replace'), position + length
+
+def signature_module_count(signature):
+	# Version 2 is pipe-delimited text, version 3 is base64 of a flags byte and the varint encoding
+	# from extension/CrashSignature.cpp, optionally deflated.
+	if not signature.startswith('3|'):
+		return signature.count('|M|')
+
+	payload = base64.b64decode(signature[2:])
+	data = payload[1:]
+	if payload[0] & 1:
+		size, position = read_varint(payload, 1)
+		data = zlib.decompress(payload[position:])
+		if len(data) != size:
+			raise ValueError('Inflated signature size mismatch')
+
+	position = 0
+	_, position = read_varint(data, position)  # timestamp
+	_, position = read_string(data, position)  # os
+	_, position = read_string(data, position)  # cpu
+	_, position = read_varint(data, position)  # crashed
+	_, position = read_string(data, position)  # crash reason
+	_, position = read_varint(data, position)  # crash address
+	_, position = read_varint(data, position)  # requesting thread
+	moduleCount, position = read_varint(data, position)
+	return moduleCount
+
+class CollectorHandler(BaseHTTPRequestHandler):
+	protocol_version = 'HTTP/1.1'
+
+	def log_message(self, format, *args):
+		if self.server.options.verbose:
+			BaseHTTPRequestHandler.log_message(self, format, *args)
+
+	def parse_form(self, body):
+		header = 'Content-Type: %s\r\n\r\n' % self.headers.get('Content-Type', '')
+		message = email.parser.BytesParser(policy=email.policy.HTTP).parsebytes(header.encode() + body)
+
+		fields = {}
+		if message.is_multipart():
+			for part in message.iter_parts():
+				name = part.get_param('name', header='content-disposition')
+				if name:
+					fields[name] = part.get_payload(decode=True) or b''
+		return fields
+
+	def respond(self, code, text):
+		data = text.encode()
+		self.send_response(code)
+		self.send_header('Content-Type', 'text/plain')
+		self.send_header('Content-Length', str(len(data)))
+		self.end_headers()
+		self.wfile.write(data)
+
+	def presubmit_response(self, signature):
+		options = self.server.options
+		moduleCount = signature_module_count(signature)
+
+		modules = ''
+		for i in range(moduleCount):
+			roll = random.random()
+			if roll < options.symbol_rate:
+				modules += 'Y'
+			elif roll < options.symbol_rate + options.binary_rate:
+				modules += 'U'
+			else:
+				modules += 'N'
+
+		verdict = 'M' if random.random() < options.metadata_only_rate else 'Y'
+		return '%s|%s|%s' % (verdict, modules, uuid.uuid4())
+
+	def do_POST(self):
+		start = time.time()
+		options = self.server.options
+
+		length = int(self.headers.get('Content-Length', 0))
+		body = self.rfile.read(length)
+		fields = self.parse_form(body)
+
+		if self.path.startswith('/symbols'):
+			stage = 'symbols'
+		elif self.path.startswith('/binary'):
+			stage = 'binary'
+		elif 'CrashSignature' in fields or 'CrashSignatureCount' in fields:
+			stage = 'presubmit'
+		else:
+			stage = 'crash'
+
+		latency = getattr(options, stage + '_latency')
+		if latency > 0:
+			time.sleep(random.uniform(latency * 0.5, latency * 1.5) / 1000.0)
+
+		failed = random.random() < options.error_rate
+		if failed:
+			self.respond(500, 'Internal Server Error')
+		elif stage == 'presubmit' and 'CrashSignatureCount' in fields:
+			# Batch presubmit (MinidumpPresubmitBatch), one response line per signature.
+			count = int(fields['CrashSignatureCount'])
+			self.respond(200, '\n'.join(self.presubmit_response(fields['CrashSignature%d' % i].decode('utf-8', 'replace')) for i in range(count)))
+		elif stage == 'presubmit':
+			self.respond(200, self.presubmit_response(fields['CrashSignature'].decode('utf-8', 'replace')))
+		elif stage == 'crash':
+			crashId = uuid.uuid4().hex.upper()
+			self.respond(200, 'Crash ID: %s-%s-%s' % (crashId[0:4], crashId[4:8], crashId[8:12]))
+		else:
+			self.respond(200, 'OK')
+
+		self.server.stats.record(stage, start, time.time(), length, failed)
+
+def main():
+	parser = argparse.ArgumentParser(description='Mock Accelerator crash collector for load testing.')
+	parser.add_argument('--host', default='127.0.0.1')
+	parser.add_argument('--port', type=int, default=8080)
+	parser.add_argument('--presubmit-latency', type=float, default=50, help='Mean presubmit latency in ms')
+	parser.add_argument('--crash-latency', type=float, default=200, help='Mean crash upload latency in ms')
+	parser.add_argument('--symbols-latency', type=float, default=100, help='Mean symbol upload latency in ms')
+	parser.add_argument('--binary-latency', type=float, default=300, help='Mean binary upload latency in ms')
+	parser.add_argument('--error-rate', type=float, default=0.0, help='Fraction of requests answered with HTTP 500')
+	parser.add_argument('--symbol-rate', type=float, default=0.1, help='Fraction of modules to request symbols for')
+	parser.add_argument('--binary-rate', type=float, default=0.0, help='Fraction of modules to request binaries for')
+	parser.add_argument('--metadata-only-rate', type=float, default=0.0, help='Fraction of presubmits answered with M')
+	parser.add_argument('--pid', type=int, default=0, help='srcds pid to report peak RSS for')
+	parser.add_argument('--seed', type=int, default=None, help='Random seed for reproducible runs')
+	parser.add_argument('--verbose', action='store_true')
+	options = parser.parse_args()
+
+	if options.seed is not None:
+		random.seed(options.seed)
+
+	server = ThreadingHTTPServer((options.host, options.port), CollectorHandler)
+	server.options = options
+	server.stats = Stats()
+
+	def shutdown(signum, frame):
+		threading.Thread(target=server.shutdown).start()
+	signal.signal(signal.SIGTERM, shutdown)
+
+	print('Mock collector listening on http://%s:%d/' % (options.host, options.port))
+	try:
+		server.serve_forever()
+	except KeyboardInterrupt:
+		pass
+
+	server.stats.report(options.pid)
+
+if __name__ == '__main__':
+	main()